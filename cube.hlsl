@@ -9,6 +9,7 @@ cbuffer UBO : register(b0, space1)
 struct VSInput
 {
     float2 Position : TEXCOORD0;
+    float4 Color : TEXCOORD1;
 };
 
 struct VSOutput
@@ -20,7 +21,7 @@ struct VSOutput
 VSOutput VSMain(VSInput input)
 {
     VSOutput output;
-    output.Color = u_Color;
+    output.Color = input.Color;
     output.Position = mul(u_ProjectionTransformMatrix, float4(input.Position, 1.0f, 1.0f));
     return output;
 }
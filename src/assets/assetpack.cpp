@@ -0,0 +1,292 @@
+#include "assetpack.h"
+
+#include <graphics/image.h>
+#include <graphics/texture/blockencoder.h>
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char PackMagic[4] = { 'D', 'K', 'P', 'K' };
+
+int compareName(const char* entryName, const std::string& name)
+{
+    return strncmp(entryName, name.c_str(), AssetPack::NameLength);
+}
+
+}
+
+AssetPack::~AssetPack()
+{
+    unmap();
+}
+
+AssetPackPtr AssetPack::open(const std::string& path)
+{
+    AssetPackPtr pack = AssetPackPtr(new AssetPack);
+    if(!pack->map(path) || !pack->validate(path))
+        return nullptr;
+    return pack;
+}
+
+bool AssetPack::map(const std::string& path)
+{
+#ifdef _WIN32
+    m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(m_file == INVALID_HANDLE_VALUE) {
+        m_file = nullptr;
+        SDL_Log("AssetPack: cannot open %s.", path.c_str());
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart == 0) {
+        SDL_Log("AssetPack: %s is empty.", path.c_str());
+        return false;
+    }
+    m_size = (size_t)fileSize.QuadPart;
+
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    m_data = m_mapping ? (uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_COPY, 0, 0, 0) : nullptr;
+    if(!m_data) {
+        SDL_Log("AssetPack: cannot map %s.", path.c_str());
+        return false;
+    }
+#else
+    int file = ::open(path.c_str(), O_RDONLY);
+    if(file < 0) {
+        SDL_Log("AssetPack: cannot open %s.", path.c_str());
+        return false;
+    }
+
+    struct stat fileInfo;
+    if(fstat(file, &fileInfo) != 0 || fileInfo.st_size == 0) {
+        SDL_Log("AssetPack: %s is empty.", path.c_str());
+        close(file);
+        return false;
+    }
+    m_size = (size_t)fileInfo.st_size;
+
+    // the mapping holds its own reference to the file
+    void* data = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    close(file);
+    if(data == MAP_FAILED) {
+        SDL_Log("AssetPack: cannot map %s.", path.c_str());
+        return false;
+    }
+    m_data = (uint8_t*)data;
+#endif
+    return true;
+}
+
+bool AssetPack::validate(const std::string& path)
+{
+    if(m_size < sizeof(Header)) {
+        SDL_Log("AssetPack: %s is truncated.", path.c_str());
+        return false;
+    }
+
+    const Header* header = (const Header*)m_data;
+    if(memcmp(header->magic, PackMagic, sizeof(PackMagic)) != 0 || header->version != Version) {
+        SDL_Log("AssetPack: %s is not a version %d pack.", path.c_str(), (int)Version);
+        return false;
+    }
+    if(header->fileSize != m_size || header->indexOffset > m_size ||
+       (m_size - header->indexOffset) / sizeof(Entry) < header->entryCount || header->indexOffset % alignof(Entry) != 0) {
+        SDL_Log("AssetPack: %s has a broken index.", path.c_str());
+        return false;
+    }
+
+    // checked once here, lookups trust the index afterwards
+    const Entry* entries = (const Entry*)(m_data + header->indexOffset);
+    for(uint32_t i = 0; i < header->entryCount; ++i) {
+        const Entry& entry = entries[i];
+        if(entry.offset > m_size || entry.size > m_size - entry.offset ||
+           (i > 0 && strncmp(entries[i - 1].name, entry.name, NameLength) >= 0)) {
+            SDL_Log("AssetPack: %s has a broken entry %u.", path.c_str(), i);
+            return false;
+        }
+    }
+
+    m_header = header;
+    m_entries = entries;
+    return true;
+}
+
+void AssetPack::unmap()
+{
+#ifdef _WIN32
+    if(m_data)
+        UnmapViewOfFile(m_data);
+    if(m_mapping)
+        CloseHandle(m_mapping);
+    if(m_file)
+        CloseHandle(m_file);
+    m_mapping = nullptr;
+    m_file = nullptr;
+#else
+    if(m_data)
+        munmap(m_data, m_size);
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_header = nullptr;
+    m_entries = nullptr;
+}
+
+void AssetPack::prefetch(const uint8_t* data, size_t size) const
+{
+#ifdef _WIN32
+    (void)data;
+    (void)size;
+#else
+    // madvise wants a page aligned start
+    uintptr_t pageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t begin = (uintptr_t)data & ~(pageSize - 1);
+    madvise((void*)begin, size + ((uintptr_t)data - begin), MADV_WILLNEED);
+#endif
+}
+
+const AssetPack::Entry* AssetPack::findEntry(const std::string& name) const
+{
+    if(!m_entries || name.size() >= NameLength)
+        return nullptr;
+
+    const Entry* end = m_entries + m_header->entryCount;
+    const Entry* entry = std::lower_bound(m_entries, end, name, [](const Entry& entry, const std::string& name) {
+        return compareName(entry.name, name) < 0;
+    });
+    if(entry == end || compareName(entry->name, name) != 0)
+        return nullptr;
+    return entry;
+}
+
+const uint8_t* AssetPack::find(const std::string& name, size_t* size) const
+{
+    const Entry* entry = findEntry(name);
+    if(!entry)
+        return nullptr;
+    if(size)
+        *size = (size_t)entry->size;
+    return m_data + entry->offset;
+}
+
+ImagePtr AssetPack::loadImage(const std::string& name)
+{
+    const Entry* entry = findEntry(name);
+    if(!entry || entry->type != ImageEntry) {
+        SDL_Log("AssetPack: there is no image %s.", name.c_str());
+        return nullptr;
+    }
+
+    SDL_GPUTextureFormat format = (SDL_GPUTextureFormat)entry->format;
+    SizeI size((int)entry->width, (int)entry->height);
+    if(!size.isValid() || entry->size < BlockEncoder::getDataSize(format, size)) {
+        SDL_Log("AssetPack: image %s is smaller than its size says.", name.c_str());
+        return nullptr;
+    }
+
+    const uint8_t* data = m_data + entry->offset;
+    prefetch(data, (size_t)entry->size);
+    return ImagePtr(new Image(data, size, format, shared_from_this()));
+}
+
+bool AssetPackWriter::add(const std::string& name, const void* data, size_t size)
+{
+    return addEntry(name, data, size, AssetPack::RawEntry, 0, SizeI(0, 0));
+}
+
+bool AssetPackWriter::addImage(const std::string& name, const Image& image)
+{
+    return addEntry(name, image.getPixelData(), image.getPixelDataSize(), AssetPack::ImageEntry, image.getFormat(), image.getSize());
+}
+
+bool AssetPackWriter::addEntry(const std::string& name, const void* data, size_t size, uint32_t type, uint32_t format, const SizeI& imageSize)
+{
+    if(name.empty() || name.size() >= AssetPack::NameLength) {
+        SDL_Log("AssetPackWriter: name '%s' doesn't fit in %d characters.", name.c_str(), AssetPack::NameLength - 1);
+        return false;
+    }
+    for(const AssetPack::Entry& entry : m_entries) {
+        if(compareName(entry.name, name) == 0) {
+            SDL_Log("AssetPackWriter: %s was added twice.", name.c_str());
+            return false;
+        }
+    }
+
+    AssetPack::Entry entry;
+    memset(&entry, 0, sizeof(entry));
+    memcpy(entry.name, name.c_str(), name.size());
+    entry.size = size;
+    entry.type = type;
+    entry.format = format;
+    entry.width = (uint32_t)imageSize.w;
+    entry.height = (uint32_t)imageSize.h;
+    m_entries.push_back(entry);
+    m_blobs.emplace_back((const uint8_t*)data, (const uint8_t*)data + size);
+    return true;
+}
+
+bool AssetPackWriter::write(const std::string& path)
+{
+    // the index is looked up by binary search, so it goes out sorted
+    std::vector<size_t> order(m_entries.size());
+    for(size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return strncmp(m_entries[a].name, m_entries[b].name, AssetPack::NameLength) < 0;
+    });
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if(!f) {
+        SDL_Log("AssetPackWriter: cannot create %s.", path.c_str());
+        return false;
+    }
+
+    const uint8_t padding[AssetPack::Alignment] = {};
+    uint64_t offset = (sizeof(AssetPack::Header) + AssetPack::Alignment - 1) & ~(uint64_t)(AssetPack::Alignment - 1);
+    bool ok = fseek(f, (long)offset, SEEK_SET) == 0;
+
+    std::vector<AssetPack::Entry> index;
+    index.reserve(order.size());
+    for(size_t i : order) {
+        AssetPack::Entry entry = m_entries[i];
+        entry.offset = offset;
+        index.push_back(entry);
+
+        const std::vector<uint8_t>& blob = m_blobs[i];
+        uint64_t aligned = (blob.size() + AssetPack::Alignment - 1) & ~(uint64_t)(AssetPack::Alignment - 1);
+        ok = ok && fwrite(blob.data(), 1, blob.size(), f) == blob.size();
+        ok = ok && fwrite(padding, 1, (size_t)(aligned - blob.size()), f) == aligned - blob.size();
+        offset += aligned;
+    }
+
+    AssetPack::Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PackMagic, sizeof(PackMagic));
+    header.version = AssetPack::Version;
+    header.entryCount = (uint32_t)index.size();
+    header.alignment = AssetPack::Alignment;
+    header.indexOffset = offset;
+    header.fileSize = offset + index.size() * sizeof(AssetPack::Entry);
+
+    ok = ok && fwrite(index.data(), sizeof(AssetPack::Entry), index.size(), f) == index.size();
+    ok = ok && fseek(f, 0, SEEK_SET) == 0;
+    ok = ok && fwrite(&header, sizeof(header), 1, f) == 1;
+    ok = fclose(f) == 0 && ok;
+    if(!ok)
+        SDL_Log("AssetPackWriter: failed writing %s.", path.c_str());
+    return ok;
+}
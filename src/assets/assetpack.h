@@ -0,0 +1,97 @@
+#ifndef ASSETPACK_H
+#define ASSETPACK_H
+
+#include <utils/include.h>
+#include <utils/size.h>
+
+#include <string>
+
+class AssetPack;
+using AssetPackPtr = std::shared_ptr<AssetPack>;
+
+// Read only archive of blobs behind a sorted index, opened by mapping the whole file. Lookups and
+// loads allocate nothing for the data itself: images are views into the mapping, so their upload
+// copies straight from the file pages into the GPU transfer buffer.
+//     AssetPackPtr pack = AssetPack::open("data.pack");
+//     texture->uploadPixels(pack->loadImage("ui/button"));
+// The mapping is copy on write, writing to a loaded image only costs a private copy of its pages.
+class AssetPack : public std::enable_shared_from_this<AssetPack> {
+public:
+    enum EntryType : uint32_t {
+        RawEntry = 0,
+        ImageEntry = 1
+    };
+
+    enum {
+        Version = 1,
+        NameLength = 48,
+        Alignment = 64 // every blob starts on a cache line, image rows can be read as uint32_t
+    };
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t entryCount;
+        uint32_t alignment;
+        uint64_t indexOffset;
+        uint64_t fileSize;
+    };
+
+    struct Entry {
+        char name[NameLength]; // zero padded, entries are sorted by it
+        uint64_t offset;
+        uint64_t size;
+        uint32_t type;
+        uint32_t format; // SDL_GPUTextureFormat of image entries
+        uint32_t width;
+        uint32_t height;
+    };
+
+    ~AssetPack();
+
+    static AssetPackPtr open(const std::string& path);
+
+    const Entry* findEntry(const std::string& name) const;
+    // the blob as it sits in the mapping, valid while the pack is alive
+    const uint8_t* find(const std::string& name, size_t* size = nullptr) const;
+    // a view into the mapping that keeps the pack alive, nullptr if there is no such image
+    ImagePtr loadImage(const std::string& name);
+
+    uint32_t getEntryCount() const { return m_header ? m_header->entryCount : 0; }
+    const Entry* getEntries() const { return m_entries; }
+
+private:
+    AssetPack() = default;
+
+    bool map(const std::string& path);
+    bool validate(const std::string& path);
+    void unmap();
+    // asks the OS to start reading the pages in, so the copy into transfer memory doesn't stall on them
+    void prefetch(const uint8_t* data, size_t size) const;
+
+    uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    const Header* m_header = nullptr;
+    const Entry* m_entries = nullptr;
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#endif
+};
+
+// Builds pack files for the asset pipeline, everything is kept in memory until write().
+class AssetPackWriter {
+public:
+    bool add(const std::string& name, const void* data, size_t size);
+    // compressed images are stored as they are, see BlockEncoder
+    bool addImage(const std::string& name, const Image& image);
+    bool write(const std::string& path);
+
+private:
+    bool addEntry(const std::string& name, const void* data, size_t size, uint32_t type, uint32_t format, const SizeI& imageSize);
+
+    std::vector<AssetPack::Entry> m_entries;
+    std::vector<std::vector<uint8_t>> m_blobs;
+};
+
+#endif
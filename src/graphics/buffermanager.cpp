@@ -1,12 +1,79 @@
 #include "buffermanager.h"
-#include "renderbuffer.h"
+#include "displaylist.h"
+#include "retainedgeometry.h"
 
 #include <graphics/texture/texture.h>
 #include <graphics/painter.h>
 
-BufferManager::BufferManager()
+#include <cfloat>
+
+static inline void hashCombine(size_t& seed, size_t value)
+{
+    seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+static inline size_t hashFloat(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+size_t PainterState::hash() const
+{
+    size_t seed = std::hash<const void*>()(program);
+    hashCombine(seed, (size_t)resolution.w);
+    hashCombine(seed, (size_t)resolution.h);
+    hashCombine(seed, (size_t)viewport.x());
+    hashCombine(seed, (size_t)viewport.y());
+    hashCombine(seed, (size_t)viewport.width());
+    hashCombine(seed, (size_t)viewport.height());
+    hashCombine(seed, (size_t)clipRect.x());
+    hashCombine(seed, (size_t)clipRect.y());
+    hashCombine(seed, (size_t)clipRect.width());
+    hashCombine(seed, (size_t)clipRect.height());
+    for(int i = 0; i < 9; ++i) {
+        hashCombine(seed, hashFloat(transformMatrix.data()[i]));
+        hashCombine(seed, hashFloat(projectionMatrix.data()[i]));
+    }
+    hashCombine(seed, hashFloat(opacity));
+    hashCombine(seed, hashFloat(lineWidth));
+    hashCombine(seed, hashFloat(pointSize));
+    hashCombine(seed, (size_t)blendMode);
+    return seed;
+}
+
+bool PainterState::equals(const PainterState& other) const
+{
+    return program == other.program && resolution == other.resolution && viewport == other.viewport && clipRect == other.clipRect &&
+        transformMatrix == other.transformMatrix && projectionMatrix == other.projectionMatrix && opacity == other.opacity &&
+        lineWidth == other.lineWidth && pointSize == other.pointSize && blendMode == other.blendMode;
+}
+
+int PainterState::diff(const PainterState& previous) const
+{
+    int flags = 0;
+    if(program != previous.program)
+        flags |= MustUpdateProgram;
+    if(lineWidth != previous.lineWidth)
+        flags |= MustUpdateLineWidth;
+    if(pointSize != previous.pointSize)
+        flags |= MustUpdatePointSize;
+    if(blendMode != previous.blendMode)
+        flags |= MustUpdateBlendMode;
+    if(clipRect != previous.clipRect)
+        flags |= MustUpdateClipRect;
+    if(resolution != previous.resolution)
+        flags |= MustUpdateResolution;
+    if(viewport != previous.viewport)
+        flags |= MustUpdateViewport;
+    if(transformMatrix != previous.transformMatrix || projectionMatrix != previous.projectionMatrix)
+        flags |= MustUpdateProjectionTransformMatrix;
+    return flags;
+}
+
+BufferManager::BufferManager(bool mappedVertices) : m_vertexBuffer(mappedVertices)
 {
-    m_renderBuffer = std::make_shared<RenderBuffer>();
 }
 
 BufferManager::~BufferManager()
@@ -17,6 +84,9 @@ void BufferManager::clear(const Color& color)
 {
     m_vertexBuffer.reset();
     m_drawCommands.reset();
+    m_commandStrides.reset();
+    m_commandBounds.reset();
+    clearTextures();
     m_clearColor = color;
 }
 
@@ -24,7 +94,165 @@ void BufferManager::reset()
 {
     m_vertexBuffer.reset();
     m_drawCommands.reset();
-    m_pendingTextures.clear();
+    m_commandStrides.reset();
+    m_commandBounds.reset();
+    clearTextures();
+    m_loadOp = SDL_GPU_LOADOP_CLEAR;
+    m_storeOp = SDL_GPU_STOREOP_STORE;
+}
+
+void BufferManager::clearTextures()
+{
+    m_retainedBlocks.clear();
+    m_textures.clear();
+    m_textureHandles.clear();
+    m_lastTexture = nullptr;
+    m_lastTextureHandle = 0;
+}
+
+uint16_t BufferManager::addTexture(const TexturePtr& texture)
+{
+    uint16_t handle;
+    auto it = m_textureHandles.find(texture.get());
+    if(it != m_textureHandles.end())
+        handle = it->second;
+    else {
+        if(m_textures.size() >= InvalidTextureHandle - 1) {
+            SDL_Log("BufferManager: too many textures in one frame, dropping the draw.");
+            return InvalidTextureHandle;
+        }
+        m_textures.push_back(texture);
+        handle = (uint16_t)m_textures.size();
+        m_textureHandles.emplace(texture.get(), handle);
+    }
+
+    m_lastTexture = texture.get();
+    m_lastTextureHandle = handle;
+    return handle;
+}
+
+void BufferManager::append(const BufferManager& source, const std::vector<size_t>& stateRemap)
+{
+    uint32_t retainedBase = (uint32_t)m_retainedBlocks.size();
+    m_retainedBlocks.insert(m_retainedBlocks.end(), source.m_retainedBlocks.begin(), source.m_retainedBlocks.end());
+
+    const DrawCommand* commands = source.m_drawCommands.data();
+    const uint16_t* strides = source.m_commandStrides.data();
+    const DrawBounds* bounds = source.m_commandBounds.data();
+    size_t count = source.m_drawCommands.size();
+    size_t begin = 0;
+    for(size_t i = 0; i <= count; ++i) {
+        if(i < count && !commands[i].isRetained())
+            continue;
+
+        appendCommands(commands + begin, strides + begin, bounds + begin, i - begin, source.m_vertexBuffer.data(), source.m_textures, stateRemap, PointF());
+        begin = i + 1;
+        if(i == count)
+            break;
+
+        // retained vertices don't move, only the block index and the handles are remapped
+        const DrawCommand& sourceCommand = commands[i];
+        uint16_t texture = sourceCommand.texture != 0 ? getTextureHandle(source.m_textures[sourceCommand.texture - 1]) : 0;
+        if(texture == InvalidTextureHandle)
+            continue;
+        DrawCommand& drawCommand = m_drawCommands.emplace_back();
+        drawCommand = sourceCommand;
+        if(sourceCommand.flags & DrawCommand::BindRetained)
+            drawCommand.offset += retainedBase;
+        drawCommand.state = (uint32_t)stateRemap[sourceCommand.state];
+        drawCommand.texture = texture;
+        m_commandStrides.emplace_back() = strides[i];
+        m_commandBounds.emplace_back() = bounds[i];
+    }
+}
+
+void BufferManager::append(const DisplayList& source, const std::vector<size_t>& stateRemap, const PointF& translation)
+{
+    appendCommands(source.commands.data(), source.strides.data(), source.bounds.data(), source.commands.size(), source.vertices.data(), source.textures, stateRemap, translation);
+}
+
+void BufferManager::appendCommands(const DrawCommand* commands, const uint16_t* strides, const DrawBounds* bounds, size_t count, const unsigned char* vertices,
+                                   const std::vector<TexturePtr>& textures, const std::vector<size_t>& stateRemap, const PointF& translation)
+{
+    bool translate = !translation.isNull();
+    for(size_t i = 0; i < count; ++i) {
+        const DrawCommand& sourceCommand = commands[i];
+        uint16_t texture = sourceCommand.texture != 0 ? getTextureHandle(textures[sourceCommand.texture - 1]) : 0;
+        if(texture == InvalidTextureHandle)
+            continue;
+
+        size_t stride = strides[i];
+        size_t size = (size_t)sourceCommand.vertexCount * stride;
+
+        // same alignment rule as addVertices, offsets stay in units of the command's own stride
+        size_t padding = (stride - m_vertexBuffer.size() % stride) % stride;
+        size_t index = m_vertexBuffer.add(padding + size) + padding;
+        memcpy(&m_vertexBuffer[index], vertices + (size_t)sourceCommand.offset * stride, size);
+
+        // every vertex layout starts with its x and y position, instances with their top left
+        if(translate) {
+            for(size_t vertex = 0; vertex < size; vertex += stride) {
+                float* position = &m_vertexBuffer.at<float&>(index + vertex);
+                position[0] += translation.x;
+                position[1] += translation.y;
+            }
+        }
+
+        uint32_t offset = (uint32_t)(index / stride);
+        uint32_t state = (uint32_t)stateRemap[sourceCommand.state];
+
+        if(m_drawCommands.size() > 0) {
+            DrawCommand& lastCommand = m_drawCommands.back();
+            if(lastCommand.canBatch(sourceCommand.getType(), state, texture, offset, sourceCommand.flags)) {
+                lastCommand.vertexCount += sourceCommand.vertexCount;
+                m_commandBounds.back().unite(bounds[i].translated(translation));
+                continue;
+            }
+        }
+
+        DrawCommand& drawCommand = m_drawCommands.emplace_back();
+        drawCommand = sourceCommand;
+        drawCommand.offset = offset;
+        drawCommand.state = state;
+        drawCommand.texture = texture;
+        m_commandStrides.emplace_back() = (uint16_t)stride;
+        m_commandBounds.emplace_back() = bounds[i].translated(translation);
+    }
+}
+
+void BufferManager::addRetained(const RetainedBlockPtr& block, const std::vector<size_t>& stateRemap)
+{
+    if(!block || block->commands.empty())
+        return;
+
+    DrawCommand& bindCommand = m_drawCommands.emplace_back();
+    bindCommand = DrawCommand();
+    bindCommand.offset = (uint32_t)m_retainedBlocks.size();
+    bindCommand.state = (uint32_t)stateRemap[block->commands[0].state];
+    bindCommand.flags = DrawCommand::BindRetained;
+    m_commandStrides.emplace_back() = 1;
+    m_commandBounds.emplace_back() = DrawBounds();
+    m_retainedBlocks.push_back(block);
+
+    for(size_t i = 0; i < block->commands.size(); ++i) {
+        const DrawCommand& blockCommand = block->commands[i];
+        uint16_t texture = blockCommand.texture != 0 ? getTextureHandle(block->textures[blockCommand.texture - 1]) : 0;
+        if(texture == InvalidTextureHandle)
+            continue;
+        DrawCommand& drawCommand = m_drawCommands.emplace_back();
+        drawCommand = blockCommand;
+        drawCommand.flags |= DrawCommand::Retained;
+        drawCommand.state = (uint32_t)stateRemap[blockCommand.state];
+        drawCommand.texture = texture;
+        m_commandStrides.emplace_back() = block->strides[i];
+        m_commandBounds.emplace_back() = block->bounds[i];
+    }
+}
+
+void BufferManager::bindTexture(SDL_GPURenderPass* renderPass, uint16_t handle)
+{
+    if(handle != 0)
+        m_textures[handle - 1]->bind(renderPass);
 }
 
 void BufferManager::setTexture(const TexturePtr& texture)
@@ -33,27 +261,133 @@ void BufferManager::setTexture(const TexturePtr& texture)
     m_width = size.w;
     m_height = size.h;
     m_texture = texture->get();
+    m_targetTexture = texture;
 }
 
-void BufferManager::uploadPendingTextures(SDL_GPUCommandBuffer* commandBuffer)
+void BufferManager::inherit(const BufferManager& other)
 {
-    for(const TexturePtr& texture : m_pendingTextures)
-        texture->upload(commandBuffer);
+    m_texture = other.m_texture;
+    m_targetTexture = other.m_targetTexture;
+    m_width = other.m_width;
+    m_height = other.m_height;
+    m_clearColor = other.m_clearColor;
 }
 
-SDL_GPUBuffer *BufferManager::getBuffer(uint32_t frameIndex)
+
+struct CommandBounds {
+    float x1, y1, x2, y2;
+    const Matrix3* projection;
+
+    bool overlaps(const CommandBounds& other) const {
+        // bounds in different projections can't be compared, keep their order
+        if(*projection != *other.projection)
+            return true;
+        return x1 < other.x2 && other.x1 < x2 && y1 < other.y2 && other.y1 < y2;
+    }
+};
+
+// program (blend, instancing, primitive), then texture, then state
+static uint64_t getSortKey(const DrawCommand& drawCommand, const PainterState& state)
 {
-    return m_renderBuffer->acquireVertexBuffer(m_vertexBuffer.size(), frameIndex);
+    return ((uint64_t)state.blendMode << 56) | ((uint64_t)(drawCommand.flags & 0xf) << 52) | ((uint64_t)(drawCommand.type & 0xf) << 48) |
+        ((uint64_t)drawCommand.texture << 32) | (uint64_t)drawCommand.state;
 }
 
-void BufferManager::upload(uint32_t frameIndex)
+static CommandBounds transformBounds(const DrawBounds& drawBounds, const PainterState& state)
 {
-    m_renderBuffer->upload((void*)m_vertexBuffer.data(), m_vertexBuffer.size(), frameIndex);
+    const Matrix3& m = state.transformMatrix;
+    float corners[4][2] = { { drawBounds.x1, drawBounds.y1 }, { drawBounds.x2, drawBounds.y1 }, { drawBounds.x1, drawBounds.y2 }, { drawBounds.x2, drawBounds.y2 } };
+    CommandBounds bounds = { FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, &state.projectionMatrix };
+    for(const auto& corner : corners) {
+        float x = corner[0] * m(1,1) + corner[1] * m(2,1) + m(3,1);
+        float y = corner[0] * m(1,2) + corner[1] * m(2,2) + m(3,2);
+        bounds.x1 = std::min(bounds.x1, x);
+        bounds.y1 = std::min(bounds.y1, y);
+        bounds.x2 = std::max(bounds.x2, x);
+        bounds.y2 = std::max(bounds.y2, y);
+    }
+
+    // lines and points reach past their vertices, and rasterization rounds outward
+    float margin = std::max(state.lineWidth, state.pointSize) * 0.5f + 1.0f;
+    bounds.x1 -= margin;
+    bounds.y1 -= margin;
+    bounds.x2 += margin;
+    bounds.y2 += margin;
+    return bounds;
 }
 
-void DrawCommand::bindTexture(SDL_GPURenderPass* renderPass)
+void BufferManager::reorder(const std::vector<PainterState>& states, size_t lookback)
 {
-    if(texture)
-        texture->bind(renderPass);
-    texture = nullptr;
+    size_t count = m_drawCommands.size();
+    if(count < 3)
+        return;
+
+    static std::vector<CommandBounds> bounds;
+    static std::vector<uint64_t> keys;
+    static std::vector<uint32_t> order;
+    bounds.resize(count);
+    keys.resize(count);
+    order.clear();
+
+    static const Matrix3 barrierProjection;
+    for(size_t i = 0; i < count; ++i) {
+        const DrawCommand& drawCommand = m_drawCommands[i];
+        const PainterState& state = states[drawCommand.state];
+        if(drawCommand.isRetained()) {
+            // retained commands come from another recording; make them barriers that never move and can't be jumped
+            bounds[i] = { -FLT_MAX, -FLT_MAX, FLT_MAX, FLT_MAX, &barrierProjection };
+            keys[i] = ~(uint64_t)i;
+            continue;
+        }
+        bounds[i] = transformBounds(m_commandBounds[i], state);
+        keys[i] = getSortKey(drawCommand, state);
+    }
+
+    bool moved = false;
+    for(uint32_t i = 0; i < count; ++i) {
+        // walk back from the end looking for a command with the same key, stop at the first one this command would draw over
+        size_t target = order.size();
+        size_t limit = order.size() > lookback ? order.size() - lookback : 0;
+        for(size_t j = order.size(); j > limit; --j) {
+            uint32_t other = order[j - 1];
+            if(keys[other] == keys[i]) {
+                target = j;
+                break;
+            }
+            if(bounds[other].overlaps(bounds[i]))
+                break;
+        }
+
+        if(target != order.size())
+            moved = true;
+        order.insert(order.begin() + target, i);
+    }
+
+    if(!moved)
+        return;
+
+    static std::vector<DrawCommand> commands;
+    static std::vector<uint16_t> strides;
+    static std::vector<DrawBounds> drawBounds;
+    commands.assign(m_drawCommands.begin(), m_drawCommands.end());
+    strides.assign(m_commandStrides.begin(), m_commandStrides.begin() + count);
+    drawBounds.assign(m_commandBounds.begin(), m_commandBounds.begin() + count);
+
+    m_drawCommands.reset();
+    m_commandStrides.reset();
+    m_commandBounds.reset();
+    for(uint32_t index : order) {
+        const DrawCommand& drawCommand = commands[index];
+        if(m_drawCommands.size() > 0) {
+            DrawCommand& lastCommand = m_drawCommands.back();
+            if(lastCommand.canBatch(drawCommand.getType(), drawCommand.state, drawCommand.texture, drawCommand.offset, drawCommand.flags)) {
+                lastCommand.vertexCount += drawCommand.vertexCount;
+                m_commandBounds.back().unite(drawBounds[index]);
+                continue;
+            }
+        }
+        m_drawCommands.emplace_back() = drawCommand;
+        m_commandStrides.emplace_back() = strides[index];
+        m_commandBounds.emplace_back() = drawBounds[index];
+    }
 }
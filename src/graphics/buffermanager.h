@@ -2,6 +2,7 @@
 #define BUFFERMANAGER_H
 
 #include <graphics/shaders/program.h>
+#include <graphics/vertexarena.h>
 
 #include <utils/include.h>
 #include <utils/color.h>
@@ -10,6 +11,8 @@
 #include <utils/size.h>
 #include <utils/matrix.h>
 
+#include <cfloat>
+
 template<typename _T>
 class DuckerVector {
 public:
@@ -37,6 +40,8 @@ public:
         return m_data[index];
     }
 
+    _T& back() { return m_data[m_size - 1]; }
+
     void reset() { m_size = 0; }
     size_t size() const { return m_size; }
     const _T* data() const { return m_data.data(); }
@@ -75,6 +80,11 @@ struct PainterState {
 
     void copy(const PainterState& state) { *this = state; }
 
+    // color is carried per vertex, so it takes no part in interning or in the draw diff
+    size_t hash() const;
+    bool equals(const PainterState& other) const;
+    int diff(const PainterState& previous) const;
+
     Program* program = nullptr;
     SizeI resolution;
     RectI viewport;
@@ -87,41 +97,103 @@ struct PainterState {
     BlendMode blendMode = BlendMode_Blend;
     RectI clipRect;
     size_t id = 0;
-    int flags = 0;
 };
 
 struct DrawCommand {
+    enum Flags : uint8_t {
+        Indexed = 1 << 0,      // vertexCount vertices drawn as quads through the shared quad index buffer
+        Instanced = 1 << 1,    // vertexCount instances starting at offset, expanded by the instanced rect program
+        Retained = 1 << 2,     // vertices live in the retained block bound by the last BindRetained command
+        BindRetained = 1 << 3  // draws nothing, binds the retained block at index offset of the manager's list
+    };
+
     DrawCommand() = default;
 
-    size_t vertexCount = 0;
-    size_t offset = 0;
-    size_t state = 0;
-    PrimitiveType type = LastPrimitiveType;
-    TexturePtr texture = nullptr;
+    uint32_t offset = 0;
+    uint32_t vertexCount = 0;
+    uint32_t state = 0;
+    uint16_t texture = 0; // handle into the owning BufferManager texture table, 0 means untextured
+    uint8_t type = LastPrimitiveType;
+    uint8_t flags = 0;
+
+    PrimitiveType getType() const { return (PrimitiveType)type; }
+    bool hasTexture() const { return texture != 0; }
+    bool isRetained() const { return (flags & (Retained | BindRetained)) != 0; }
+
+    bool canBatch(PrimitiveType primitiveType, uint32_t stateId, uint16_t textureHandle, uint32_t vertexOffset, uint8_t drawFlags) const {
+        return type == primitiveType && state == stateId && texture == textureHandle && offset + vertexCount == vertexOffset && flags == drawFlags &&
+            (isListPrimitive(getType()) || (flags & Instanced));
+    }
+
+    static bool isListPrimitive(PrimitiveType primitiveType) {
+        return primitiveType == PrimitiveTypeTriangleList || primitiveType == PrimitiveTypeLineList || primitiveType == PrimitiveTypePointList;
+    }
+};
+
+static_assert(sizeof(DrawCommand) == 16, "DrawCommand must stay 16 bytes");
+
+// extent of a command's vertices before its state's transform, kept next to the command by whoever
+// records it, so reordering never has to read vertex memory back
+struct DrawBounds {
+    DrawBounds() = default;
+    DrawBounds(float left, float top, float right, float bottom) : x1(left), y1(top), x2(right), y2(bottom) { }
+
+    DrawBounds translated(const PointF& offset) const { return DrawBounds(x1 + offset.x, y1 + offset.y, x2 + offset.x, y2 + offset.y); }
+
+    void unite(const DrawBounds& other) {
+        x1 = std::min(x1, other.x1);
+        y1 = std::min(y1, other.y1);
+        x2 = std::max(x2, other.x2);
+        y2 = std::max(y2, other.y2);
+    }
+
+    static DrawBounds of(const std::vector<PointF>& points) {
+        DrawBounds bounds(FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for(const PointF& point : points)
+            bounds.unite(DrawBounds(point.x, point.y, point.x, point.y));
+        return bounds;
+    }
 
-    void bindTexture(SDL_GPURenderPass* renderPass);
+    float x1 = 0.0f, y1 = 0.0f, x2 = 0.0f, y2 = 0.0f;
 };
 
 class GPUCommand;
-class RenderBuffer;
+struct DisplayList;
 class BufferManager {
 public:
-    BufferManager();
+    // mapped managers record vertices straight into transfer memory, see VertexArena
+    explicit BufferManager(bool mappedVertices = false);
     ~BufferManager();
 
+    // bounds cover every vertex the caller is about to write, untransformed
     template<typename T>
-    T* add(size_t count, PrimitiveType type, PainterState* state, TexturePtr texture = nullptr);
+    T* add(size_t count, PrimitiveType type, PainterState* state, const DrawBounds& bounds, const TexturePtr& texture = nullptr) { return addVertices<T>(count, type, state, bounds, texture, 0); }
+    // 4 vertices per quad (top left, top right, bottom left, bottom right), drawn through the shared quad index buffer
+    template<typename T>
+    T* addQuads(size_t quadCount, PainterState* state, const DrawBounds& bounds, const TexturePtr& texture = nullptr) { return addVertices<T>(quadCount * 4, PrimitiveTypeTriangleList, state, bounds, texture, DrawCommand::Indexed); }
+    template<typename T>
+    T* addInstances(size_t instanceCount, PainterState* state, const DrawBounds& bounds, const TexturePtr& texture = nullptr) { return addVertices<T>(instanceCount, PrimitiveTypeTriangleStrip, state, bounds, texture, DrawCommand::Instanced); }
     void clear(const Color& color);
     void reset();
+    // closes the recording, vertices may not be touched again until reset
+    void finish() { m_vertexBuffer.unmap(); }
 
     SDL_GPUTexture* getTexture() const { return m_texture; }
     void setTexture(const TexturePtr& texture);
-    
-    void addPendingTexture(const TexturePtr& texture) { m_pendingTextures.push_back(texture); }
-    void uploadPendingTextures(SDL_GPUCommandBuffer* commandBuffer);
+    // takes over the render target and clear color of the manager this one replaces
+    void inherit(const BufferManager& other);
+    // pooled managers must not keep their last target alive
+    void releaseTarget() { m_texture = nullptr; m_targetTexture = nullptr; }
+
+    enum {
+        // returned once the frame's texture table is full, draws using it are dropped
+        InvalidTextureHandle = UINT16_MAX
+    };
+
+    // textures referenced by the recorded commands, held once per frame instead of once per command
+    uint16_t getTextureHandle(const TexturePtr& texture);
+    void bindTexture(SDL_GPURenderPass* renderPass, uint16_t handle);
 
-    SDL_GPUBuffer* getBuffer(uint32_t frameIndex);
-    void upload(uint32_t frameIndex);
 
     auto begin() { return m_drawCommands.begin(); }
     auto end() { return m_drawCommands.end(); }
@@ -129,35 +201,103 @@ public:
     auto begin() const { return m_drawCommands.begin(); }
     auto end() const { return m_drawCommands.end(); }
 
+    // appends another manager's recording, remapping its state ids and texture handles into this one
+    void append(const BufferManager& source, const std::vector<size_t>& stateRemap);
+    // same for a display list, its vertices and bounds are moved by translation on the way so it keeps
+    // sharing the states, and the batches, of whatever it is spliced into
+    void append(const DisplayList& source, const std::vector<size_t>& stateRemap, const PointF& translation);
+    // references a retained block's commands, its vertices stay where they are on the GPU
+    void addRetained(const RetainedBlockPtr& block, const std::vector<size_t>& stateRemap);
+    const RetainedBlockPtr& getRetainedBlock(uint32_t index) const { return m_retainedBlocks[index]; }
+    const std::vector<RetainedBlockPtr>& getRetainedBlocks() const { return m_retainedBlocks; }
+
+    const DuckerVector<DrawCommand>& getCommands() const { return m_drawCommands; }
+    const DuckerVector<uint16_t>& getCommandStrides() const { return m_commandStrides; }
+    const DuckerVector<DrawBounds>& getCommandBounds() const { return m_commandBounds; }
+    const std::vector<TexturePtr>& getTextures() const { return m_textures; }
+
+    // moves commands next to an earlier command with the same sort key, only jumping over commands they don't overlap
+    void reorder(const std::vector<PainterState>& states, size_t lookback = 64);
+
     const auto& getVertexBuffer() const { return m_vertexBuffer; }
     const Color& getClearColor() const { return m_clearColor; }
 
+    // how the pass treats what its target held before and after it, reset() goes back to clear and store
+    void setLoadStoreOps(SDL_GPULoadOp loadOp, SDL_GPUStoreOp storeOp) { m_loadOp = loadOp; m_storeOp = storeOp; }
+    SDL_GPULoadOp getLoadOp() const { return m_loadOp; }
+    SDL_GPUStoreOp getStoreOp() const { return m_storeOp; }
+
     uint32_t getWidth() const { return m_width; }
     uint32_t getHeight() const { return m_height; }
 
 private:
-    DuckerVector<unsigned char> m_vertexBuffer;
+    template<typename T>
+    T* addVertices(size_t count, PrimitiveType type, PainterState* state, const DrawBounds& bounds, const TexturePtr& texture, uint8_t flags);
+    uint16_t addTexture(const TexturePtr& texture);
+    void appendCommands(const DrawCommand* commands, const uint16_t* strides, const DrawBounds* bounds, size_t count, const unsigned char* vertices,
+                        const std::vector<TexturePtr>& textures, const std::vector<size_t>& stateRemap, const PointF& translation);
+    void clearTextures();
+
+    VertexArena m_vertexBuffer;
     DuckerVector<DrawCommand> m_drawCommands;
-    std::vector<TexturePtr> m_pendingTextures;
-    RenderBufferPtr m_renderBuffer = nullptr;
+    DuckerVector<uint16_t> m_commandStrides; // vertex or instance size of each command
+    DuckerVector<DrawBounds> m_commandBounds;
+    std::vector<TexturePtr> m_textures;
+    std::vector<RetainedBlockPtr> m_retainedBlocks;
+    std::unordered_map<const Texture*, uint16_t> m_textureHandles;
+    const Texture* m_lastTexture = nullptr;
+    uint16_t m_lastTextureHandle = 0;
     SDL_GPUTexture* m_texture = nullptr;
+    TexturePtr m_targetTexture; // keeps the target alive while a recorded pass is in flight
     Color m_clearColor;
+    SDL_GPULoadOp m_loadOp = SDL_GPU_LOADOP_CLEAR;
+    SDL_GPUStoreOp m_storeOp = SDL_GPU_STOREOP_STORE;
     uint32_t m_width = 0;
     uint32_t m_height = 0;
 };
 
 template<typename T>
-inline T* BufferManager::add(size_t count, PrimitiveType type, PainterState* state, TexturePtr texture)
+inline T* BufferManager::addVertices(size_t count, PrimitiveType type, PainterState* state, const DrawBounds& bounds, const TexturePtr& texture, uint8_t flags)
 {
-    size_t index = m_vertexBuffer.add(count * sizeof(T));
+    // keep every run of T aligned to its own stride, so offsets are exact and contiguous runs can be merged
+    size_t padding = (sizeof(T) - m_vertexBuffer.size() % sizeof(T)) % sizeof(T);
+    size_t index = m_vertexBuffer.add(padding + count * sizeof(T)) + padding;
+    uint32_t offset = (uint32_t)(index / sizeof(T));
+    uint32_t stateId = (uint32_t)state->id;
+    uint16_t textureHandle = getTextureHandle(texture);
+    // the caller still writes its vertices, they just never get a command
+    if(textureHandle == InvalidTextureHandle)
+        return &m_vertexBuffer.at<T&>(index);
+
+    if(m_drawCommands.size() > 0) {
+        DrawCommand& lastCommand = m_drawCommands.back();
+        if(lastCommand.canBatch(type, stateId, textureHandle, offset, flags)) {
+            lastCommand.vertexCount += (uint32_t)count;
+            m_commandBounds.back().unite(bounds);
+            return &m_vertexBuffer.at<T&>(index);
+        }
+    }
 
     DrawCommand& drawCommand = m_drawCommands.emplace_back();
-    drawCommand.vertexCount = count;
-    drawCommand.offset = index / sizeof(T);
-    drawCommand.texture = texture;
-    drawCommand.state = state->id;
-    drawCommand.type = type;
+    drawCommand.vertexCount = (uint32_t)count;
+    drawCommand.offset = offset;
+    drawCommand.texture = textureHandle;
+    drawCommand.state = stateId;
+    drawCommand.type = (uint8_t)type;
+    drawCommand.flags = flags;
+    m_commandStrides.emplace_back() = (uint16_t)sizeof(T);
+    m_commandBounds.emplace_back() = bounds;
     return &m_vertexBuffer.at<T&>(index);
 }
 
+inline uint16_t BufferManager::getTextureHandle(const TexturePtr& texture)
+{
+    if(!texture)
+        return 0;
+    // consecutive draws almost always share a texture, so skip the table lookup for them
+    if(texture.get() == m_lastTexture)
+        return m_lastTextureHandle;
+    return addTexture(texture);
+}
+
 #endif
@@ -0,0 +1,41 @@
+#include "displaylist.h"
+#include "recordingcontext.h"
+
+void DisplayList::capture(const RecordingContext& context)
+{
+    clear();
+
+    const BufferManager* bufferManager = context.getBufferManager();
+    if(!bufferManager)
+        return;
+
+    const VertexArena& vertexBuffer = bufferManager->getVertexBuffer();
+    const DuckerVector<DrawCommand>& sourceCommands = bufferManager->getCommands();
+    const uint16_t* sourceStrides = bufferManager->getCommandStrides().data();
+    const DrawBounds* sourceBounds = bufferManager->getCommandBounds().data();
+
+    vertices.assign(vertexBuffer.data(), vertexBuffer.data() + vertexBuffer.size());
+    commands.reserve(sourceCommands.size());
+    strides.reserve(sourceCommands.size());
+    bounds.reserve(sourceCommands.size());
+    for(size_t i = 0; i < sourceCommands.size(); ++i) {
+        const DrawCommand& command = sourceCommands.data()[i];
+        if(command.isRetained())
+            continue;
+        commands.push_back(command);
+        strides.push_back(sourceStrides[i]);
+        bounds.push_back(sourceBounds[i]);
+    }
+    states = context.getStates();
+    textures = bufferManager->getTextures();
+}
+
+void DisplayList::clear()
+{
+    vertices.clear();
+    commands.clear();
+    strides.clear();
+    bounds.clear();
+    states.clear();
+    textures.clear();
+}
@@ -0,0 +1,23 @@
+#ifndef DISPLAYLIST_H
+#define DISPLAYLIST_H
+
+#include "buffermanager.h"
+
+class RecordingContext;
+
+// A compact copy of what a RecordingContext recorded, replayed with Painter::splice.
+// Retained draws are not captured, they already live on the GPU.
+struct DisplayList {
+    void capture(const RecordingContext& context);
+    void clear();
+    bool empty() const { return commands.empty(); }
+
+    std::vector<unsigned char> vertices;
+    std::vector<DrawCommand> commands;
+    std::vector<uint16_t> strides;
+    std::vector<DrawBounds> bounds;
+    std::vector<PainterState> states;
+    std::vector<TexturePtr> textures;
+};
+
+#endif
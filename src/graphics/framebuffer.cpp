@@ -37,23 +37,27 @@ void FrameBuffer::resize(const SizeI &size)
 
     if(m_texture && size == m_wantedSize)
         return;
-    
-    g_painter->genFrameBuffer(&m_fbo);
 
-    m_texture = TexturePtr(new Texture);
-    m_texture->setSize(size);
-    m_texture->setSmooth(m_smooth);
-    m_size = m_texture->getSize();
-    m_invalidated = true;
+    if(m_fbo == 0)
+        g_painter->genFrameBuffer(&m_fbo);
+
+    // sizes within the same bucket keep the current target
+    m_size = size;
     m_wantedSize = size;
-    m_texture->generate();
-    g_painter->setFrameBufferTexture(m_fbo, m_texture);
+    m_invalidated = true;
+    if(m_texture && m_texture->getSize() == RenderTargetPool::roundSize(size) && m_texture->getFormat() == m_format)
+        return;
+
+    m_texture = g_painter->getRenderTargetPool().acquire(size, m_format, m_smooth);
+    if(m_texture)
+        g_painter->setFrameBufferTexture(m_fbo, m_texture);
 }
 
 void FrameBuffer::bind()
 {
     g_painter->pushState(true);
-    g_painter->setResolution(m_size);
+    // one pixel per unit over the whole pooled target, only the top left m_size is drawn later
+    g_painter->setResolution(m_texture ? m_texture->getSize() : m_size);
     // g_painter->setViewport(RectI(0, 0, m_size));
     // g_painter->resetClipRect();
     g_painter->bindFrameBuffer(m_fbo);
@@ -71,7 +75,8 @@ void FrameBuffer::release()
 
 void FrameBuffer::draw(const RectF &dest, const RectI &src)
 {
-    g_painter->drawTexturedRect(dest, m_texture, src);
+    // instanced whatever the painter's setting, the default shader design has no other textured program
+    g_painter->drawTexturedRectInstanced(dest, m_texture, src);
 }
 
 void FrameBuffer::draw(const RectF &dest)
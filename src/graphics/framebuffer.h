@@ -14,6 +14,12 @@ public:
     static void destroyTemporaryFrameBuffer();
 
     TexturePtr getTexture() const { return m_texture; }
+    // the drawn size, the pooled texture behind it may be larger
+    SizeI getSize() const { return m_size; }
+
+    // takes effect on the next target the frame buffer acquires
+    void setFormat(SDL_GPUTextureFormat format) { m_format = format; }
+    SDL_GPUTextureFormat getFormat() const { return m_format; }
 
     void resize(const SizeI& size);
     void bind();
@@ -34,6 +40,7 @@ private:
     TexturePtr m_texture;
     SizeI m_size;
     SizeI m_wantedSize;
+    SDL_GPUTextureFormat m_format = SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM;
     bool m_invalidated = false;
     bool m_smooth = false;
 };
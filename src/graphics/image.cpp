@@ -1,5 +1,9 @@
 #include "image.h"
 
+#include "imageops.h"
+
+#include <graphics/texture/blockencoder.h>
+
 Image::Image(const SizeI& size) :
     m_size(size)
 {
@@ -23,3 +27,39 @@ Image::Image(std::vector<uint32_t> data, const SizeI& size) :
     m_pixels(std::move(data)), m_size(size)
 {
 }
+
+Image::Image(const std::vector<uint8_t>& blocks, const SizeI& size, SDL_GPUTextureFormat format) :
+    m_size(size), m_format(format)
+{
+    m_pitch = (int)BlockEncoder::getRowBytes(format, size.w);
+    m_dataSize = (int)blocks.size();
+    m_pixels.resize((blocks.size() + 3) / 4);
+    memcpy(m_pixels.data(), blocks.data(), blocks.size());
+}
+
+Image::Image(const uint8_t* data, const SizeI& size, SDL_GPUTextureFormat format, const std::shared_ptr<const void>& owner) :
+    m_size(size), m_format(format), m_owner(owner)
+{
+    // writes to a view land in the owner's memory, which must allow them (copy on write mappings do)
+    m_pitch = (int)BlockEncoder::getRowBytes(format, size.w);
+    m_dataSize = (int)BlockEncoder::getDataSize(format, size);
+    m_view = (uint32_t*)const_cast<uint8_t*>(data);
+}
+
+void Image::blit(uint32_t x, uint32_t y, const Image& source)
+{
+    if(m_format != source.m_format || m_format != SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM)
+        return;
+    if(x + source.getWidth() > getWidth() || y + source.getHeight() > getHeight())
+        return;
+
+    for(uint32_t row = 0; row < source.getHeight(); ++row)
+        memcpy(getPixelData(x, y + row), source.getPixelData(0, row), source.getWidth() * 4);
+}
+
+ImagePtr Image::generateMipmap() const
+{
+    if(m_format != SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM)
+        return nullptr;
+    return ImageOps::downscaleBox(*this);
+}
@@ -10,20 +10,39 @@ public:
     Image(int width, int height);
     Image(const uint32_t *data, int width, int height);
     Image(std::vector<uint32_t> data, const SizeI& size);
+    // already compressed blocks, see BlockEncoder; only the upload accessors apply to these
+    Image(const std::vector<uint8_t>& blocks, const SizeI& size, SDL_GPUTextureFormat format);
+    // a view of pixels or blocks owned by someone else, e.g. an AssetPack mapping; owner is kept alive
+    Image(const uint8_t* data, const SizeI& size, SDL_GPUTextureFormat format, const std::shared_ptr<const void>& owner);
 
     uint32_t getWidth() const { return m_size.w; }
     uint32_t getHeight() const { return m_size.h; }
     SizeI getSize() const { return m_size; }
 
-    void setPixel(uint32_t x, uint32_t y, uint32_t pixel) { m_pixels[m_size.w*y + x] = pixel; }
+    void setPixel(uint32_t x, uint32_t y, uint32_t pixel) { pixels()[m_size.w*y + x] = pixel; }
     void setPixelRGBA(uint32_t x, uint32_t y, uint8_t r, uint8_t g, uint8_t b, uint8_t a) { setPixel(x, y, (r << 0) | (g << 8) | (b << 16) | (a << 24)); }
-    int getPitch() { return m_size.w * 4; }
-    int getPixelDataSize() { return m_size.area() * 4; }
-    uint8_t* getPixelData(uint32_t x = 0, uint32_t y = 0) { return (uint8_t*)&m_pixels[m_size.w*y + x]; }
+    int getPitch() const { return m_format == SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM ? m_size.w * 4 : m_pitch; }
+    int getPixelDataSize() const { return m_format == SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM && !m_view ? m_size.area() * 4 : m_dataSize; }
+    SDL_GPUTextureFormat getFormat() const { return m_format; }
+    uint8_t* getPixelData(uint32_t x = 0, uint32_t y = 0) { return (uint8_t*)&pixels()[m_size.w*y + x]; }
+    const uint8_t* getPixelData(uint32_t x = 0, uint32_t y = 0) const { return (const uint8_t*)&pixels()[m_size.w*y + x]; }
+
+    // copies the whole source with its top left at x, y; it must fit
+    void blit(uint32_t x, uint32_t y, const Image& source);
+    // the next level of a mip chain, half the size with every texel the average of a 2x2 block
+    ImagePtr generateMipmap() const;
 
 private:
+    uint32_t* pixels() { return m_view ? m_view : m_pixels.data(); }
+    const uint32_t* pixels() const { return m_view ? m_view : m_pixels.data(); }
+
     SizeI m_size;
-    std::vector<uint32_t> m_pixels;
+    std::vector<uint32_t> m_pixels; // for compressed images the blocks, padded to whole words
+    SDL_GPUTextureFormat m_format = SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM;
+    int m_pitch = 0;
+    int m_dataSize = 0;
+    uint32_t* m_view = nullptr;
+    std::shared_ptr<const void> m_owner;
 };
 
 #endif
@@ -0,0 +1,731 @@
+#include "imagedecoder.h"
+#include "image.h"
+#include "imageops.h"
+
+#include <utils/size.h>
+#include <utils/threadpool.h>
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGEDECODER_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#define IMAGEDECODER_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+uint32_t readBigEndian(const uint8_t* data)
+{
+    return (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 | (uint32_t)data[2] << 8 | data[3];
+}
+
+bool checkSize(uint32_t width, uint32_t height)
+{
+    return width > 0 && height > 0 && width <= ImageDecoder::MaxSide && height <= ImageDecoder::MaxSide &&
+        (uint64_t)width * height <= ImageDecoder::MaxPixels;
+}
+
+// canonical Huffman code, short codes resolve with one table lookup
+struct HuffmanTable {
+    enum { FastBits = 10 };
+
+    uint16_t fast[1 << FastBits]; // length << 9 | symbol, 0 when the code is longer than FastBits
+    uint16_t counts[16];
+    uint16_t symbols[288];
+
+    bool build(const uint8_t* lengths, int count)
+    {
+        memset(counts, 0, sizeof(counts));
+        for(int i = 0; i < count; ++i)
+            counts[lengths[i]]++;
+        counts[0] = 0;
+
+        int left = 1;
+        for(int length = 1; length < 16; ++length) {
+            left = (left << 1) - counts[length];
+            if(left < 0)
+                return false;
+        }
+
+        uint16_t offsets[16];
+        offsets[1] = 0;
+        for(int length = 1; length < 15; ++length)
+            offsets[length + 1] = offsets[length] + counts[length];
+        for(int i = 0; i < count; ++i) {
+            if(lengths[i])
+                symbols[offsets[lengths[i]]++] = (uint16_t)i;
+        }
+
+        // deflate sends codes starting with their most significant bit, the table is indexed by the reversed code
+        memset(fast, 0, sizeof(fast));
+        int code = 0;
+        int index = 0;
+        for(int length = 1; length <= FastBits; ++length) {
+            for(int i = 0; i < counts[length]; ++i, ++code) {
+                int reversed = 0;
+                for(int bit = 0; bit < length; ++bit)
+                    reversed |= ((code >> bit) & 1) << (length - 1 - bit);
+                for(int entry = reversed; entry < (1 << FastBits); entry += 1 << length)
+                    fast[entry] = (uint16_t)(length << 9 | symbols[index + i]);
+            }
+            index += counts[length];
+            code <<= 1;
+        }
+        return true;
+    }
+};
+
+// zlib stream decoder, output has to fit in a buffer of the size the caller expects
+class Inflater {
+public:
+    Inflater(const uint8_t* data, size_t size, uint8_t* output, size_t outputSize) :
+        m_data(data), m_size(size), m_output(output), m_outputSize(outputSize) { }
+
+    bool run()
+    {
+        if(m_size < 2 || (m_data[0] & 0x0f) != 8 || (m_data[0] * 256 + m_data[1]) % 31 != 0 || (m_data[1] & 0x20)) {
+            SDL_Log("ImageDecoder: unsupported zlib stream.");
+            return false;
+        }
+        m_position = 2;
+
+        // the adler32 trailer isn't checked, PNG chunks have their own CRC and both cost more than the inflate
+        bool last = false;
+        while(!last) {
+            last = bits(1) != 0;
+            uint32_t type = bits(2);
+            bool ok = false;
+            if(type == 0)
+                ok = storedBlock();
+            else if(type == 1)
+                ok = codesBlock(fixedTables().first, fixedTables().second);
+            else if(type == 2)
+                ok = dynamicBlock();
+            if(!ok || m_paddingBits > m_bitCount) {
+                SDL_Log("ImageDecoder: broken deflate data.");
+                return false;
+            }
+        }
+        return m_outputPosition == m_outputSize;
+    }
+
+private:
+    void refill()
+    {
+        while(m_bitCount <= 56) {
+            if(m_position < m_size)
+                m_bitBuffer |= (uint64_t)m_data[m_position++] << m_bitCount;
+            else
+                m_paddingBits += 8;
+            m_bitCount += 8;
+        }
+    }
+
+    uint32_t bits(int count)
+    {
+        if(m_bitCount < count)
+            refill();
+        uint32_t value = (uint32_t)(m_bitBuffer & ((1ull << count) - 1));
+        m_bitBuffer >>= count;
+        m_bitCount -= count;
+        return value;
+    }
+
+    int decode(const HuffmanTable& table)
+    {
+        if(m_bitCount < 15)
+            refill();
+
+        uint16_t entry = table.fast[m_bitBuffer & ((1 << HuffmanTable::FastBits) - 1)];
+        if(entry) {
+            m_bitBuffer >>= entry >> 9;
+            m_bitCount -= entry >> 9;
+            return entry & 0x1ff;
+        }
+
+        int code = 0;
+        int first = 0;
+        int index = 0;
+        for(int length = 1; length < 16; ++length) {
+            code |= (int)((m_bitBuffer >> (length - 1)) & 1);
+            int count = table.counts[length];
+            if(code - count < first) {
+                m_bitBuffer >>= length;
+                m_bitCount -= length;
+                return table.symbols[index + (code - first)];
+            }
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+        }
+        return -1;
+    }
+
+    bool storedBlock()
+    {
+        bits(m_bitCount & 7);
+        uint32_t length = bits(16);
+        if((bits(16) ^ 0xffff) != length || length > m_outputSize - m_outputPosition)
+            return false;
+
+        // bytes already pulled into the bit buffer first, the rest straight from the stream
+        while(length > 0 && m_bitCount >= 8) {
+            m_output[m_outputPosition++] = (uint8_t)bits(8);
+            length--;
+        }
+        if(length > m_size - m_position)
+            return false;
+        memcpy(m_output + m_outputPosition, m_data + m_position, length);
+        m_outputPosition += length;
+        m_position += length;
+        return true;
+    }
+
+    bool dynamicBlock()
+    {
+        static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+        int literalCount = bits(5) + 257;
+        int distanceCount = bits(5) + 1;
+        int codeLengthCount = bits(4) + 4;
+        if(literalCount > 286 || distanceCount > 30)
+            return false;
+
+        uint8_t lengths[320] = {};
+        for(int i = 0; i < codeLengthCount; ++i)
+            lengths[order[i]] = (uint8_t)bits(3);
+        HuffmanTable codeLengths;
+        if(!codeLengths.build(lengths, 19))
+            return false;
+
+        int index = 0;
+        memset(lengths, 0, sizeof(lengths));
+        while(index < literalCount + distanceCount) {
+            int symbol = decode(codeLengths);
+            if(symbol < 0)
+                return false;
+            if(symbol < 16) {
+                lengths[index++] = (uint8_t)symbol;
+                continue;
+            }
+
+            uint8_t value = 0;
+            int repeat;
+            if(symbol == 16) {
+                if(index == 0)
+                    return false;
+                value = lengths[index - 1];
+                repeat = 3 + bits(2);
+            } else if(symbol == 17)
+                repeat = 3 + bits(3);
+            else
+                repeat = 11 + bits(7);
+            if(index + repeat > literalCount + distanceCount)
+                return false;
+            while(repeat--)
+                lengths[index++] = value;
+        }
+
+        if(lengths[256] == 0)
+            return false;
+        HuffmanTable literals;
+        HuffmanTable distances;
+        if(!literals.build(lengths, literalCount) || !distances.build(lengths + literalCount, distanceCount))
+            return false;
+        return codesBlock(literals, distances);
+    }
+
+    bool codesBlock(const HuffmanTable& literals, const HuffmanTable& distances)
+    {
+        static const uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        static const uint8_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        static const uint16_t distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+        static const uint8_t distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+        for(;;) {
+            int symbol = decode(literals);
+            if(symbol < 256) {
+                if(symbol < 0 || m_outputPosition == m_outputSize)
+                    return false;
+                m_output[m_outputPosition++] = (uint8_t)symbol;
+                continue;
+            }
+            if(symbol == 256)
+                return true;
+
+            symbol -= 257;
+            if(symbol >= 29)
+                return false;
+            size_t length = lengthBase[symbol] + bits(lengthExtra[symbol]);
+            int distanceSymbol = decode(distances);
+            if(distanceSymbol < 0 || distanceSymbol >= 30)
+                return false;
+            size_t distance = distanceBase[distanceSymbol] + bits(distanceExtra[distanceSymbol]);
+            if(distance > m_outputPosition || length > m_outputSize - m_outputPosition)
+                return false;
+
+            uint8_t* destination = m_output + m_outputPosition;
+            const uint8_t* source = destination - distance;
+            if(distance >= length)
+                memcpy(destination, source, length);
+            else {
+                // overlapping matches repeat the last distance bytes
+                for(size_t i = 0; i < length; ++i)
+                    destination[i] = source[i];
+            }
+            m_outputPosition += length;
+        }
+    }
+
+    static const std::pair<HuffmanTable, HuffmanTable>& fixedTables()
+    {
+        static const std::pair<HuffmanTable, HuffmanTable> tables = []() {
+            std::pair<HuffmanTable, HuffmanTable> fixed;
+            uint8_t lengths[288];
+            memset(lengths, 8, 144);
+            memset(lengths + 144, 9, 112);
+            memset(lengths + 256, 7, 24);
+            memset(lengths + 280, 8, 8);
+            fixed.first.build(lengths, 288);
+            memset(lengths, 5, 30);
+            fixed.second.build(lengths, 30);
+            return fixed;
+        }();
+        return tables;
+    }
+
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_position = 0;
+    uint64_t m_bitBuffer = 0;
+    int m_bitCount = 0;
+    int m_paddingBits = 0; // zeros fed in past the end of the stream
+    uint8_t* m_output;
+    size_t m_outputSize;
+    size_t m_outputPosition = 0;
+};
+
+enum PNGFilter {
+    FilterNone,
+    FilterSub,
+    FilterUp,
+    FilterAverage,
+    FilterPaeth
+};
+
+uint8_t paeth(int a, int b, int c)
+{
+    int pa = std::abs(b - c);
+    int pb = std::abs(a - c);
+    int pc = std::abs(a + b - 2 * c);
+    if(pa <= pb && pa <= pc)
+        return (uint8_t)a;
+    return (uint8_t)(pb <= pc ? b : c);
+}
+
+#ifdef IMAGEDECODER_SSE2
+// whole pixels of 3 or 4 bytes, every pixel depends on the one before so the gain is doing all channels at once
+template<int Bpp>
+__m128i loadPixel(const uint8_t* data)
+{
+    int value = 0;
+    memcpy(&value, data, Bpp);
+    return _mm_cvtsi32_si128(value);
+}
+
+template<int Bpp>
+void storePixel(uint8_t* data, __m128i pixel)
+{
+    int value = _mm_cvtsi128_si32(pixel);
+    memcpy(data, &value, Bpp);
+}
+
+template<int Bpp>
+void unfilterPixels(int filter, uint8_t* row, const uint8_t* previous, size_t rowBytes)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = zero;
+    __m128i c = zero;
+    for(size_t i = 0; i + Bpp <= rowBytes; i += Bpp) {
+        __m128i x = loadPixel<Bpp>(row + i);
+        __m128i b = loadPixel<Bpp>(previous + i);
+        if(filter == FilterSub)
+            a = _mm_add_epi8(x, a);
+        else if(filter == FilterAverage) {
+            // _mm_avg_epu8 rounds up, the filter rounds down
+            __m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+            a = _mm_add_epi8(x, average);
+        } else {
+            __m128i a16 = _mm_unpacklo_epi8(a, zero);
+            __m128i b16 = _mm_unpacklo_epi8(b, zero);
+            __m128i c16 = _mm_unpacklo_epi8(c, zero);
+            __m128i pa = _mm_sub_epi16(b16, c16);
+            __m128i pb = _mm_sub_epi16(a16, c16);
+            __m128i pc = _mm_add_epi16(pa, pb);
+            pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+            pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+            pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+            __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+
+            // ties go to a, then b, then c
+            __m128i useA = _mm_cmpeq_epi16(smallest, pa);
+            __m128i useB = _mm_cmpeq_epi16(smallest, pb);
+            __m128i nearest = _mm_or_si128(_mm_and_si128(useB, b16), _mm_andnot_si128(useB, c16));
+            nearest = _mm_or_si128(_mm_and_si128(useA, a16), _mm_andnot_si128(useA, nearest));
+            a = _mm_add_epi8(x, _mm_packus_epi16(nearest, nearest));
+            c = b;
+        }
+        storePixel<Bpp>(row + i, a);
+    }
+}
+#endif
+
+void unfilterRow(int filter, uint8_t* row, const uint8_t* previous, size_t rowBytes, size_t bpp)
+{
+    size_t i = 0;
+    switch(filter) {
+    case FilterNone:
+        return;
+    case FilterUp:
+#if defined(IMAGEDECODER_SSE2)
+        for(; i + 16 <= rowBytes; i += 16) {
+            __m128i sum = _mm_add_epi8(_mm_loadu_si128((const __m128i*)(row + i)), _mm_loadu_si128((const __m128i*)(previous + i)));
+            _mm_storeu_si128((__m128i*)(row + i), sum);
+        }
+#elif defined(IMAGEDECODER_NEON)
+        for(; i + 16 <= rowBytes; i += 16)
+            vst1q_u8(row + i, vaddq_u8(vld1q_u8(row + i), vld1q_u8(previous + i)));
+#endif
+        for(; i < rowBytes; ++i)
+            row[i] += previous[i];
+        return;
+    default:
+        break;
+    }
+
+#ifdef IMAGEDECODER_SSE2
+    if(bpp == 4) {
+        unfilterPixels<4>(filter, row, previous, rowBytes);
+        return;
+    }
+    if(bpp == 3) {
+        unfilterPixels<3>(filter, row, previous, rowBytes);
+        return;
+    }
+#endif
+
+    // the first pixel has no left neighbour, the filters see zeros there
+    for(; i < rowBytes; ++i) {
+        int left = i >= bpp ? row[i - bpp] : 0;
+        int upLeft = i >= bpp ? previous[i - bpp] : 0;
+        if(filter == FilterSub)
+            row[i] += (uint8_t)left;
+        else if(filter == FilterAverage)
+            row[i] += (uint8_t)((left + previous[i]) >> 1);
+        else
+            row[i] += paeth(left, previous[i], upLeft);
+    }
+}
+
+struct PNGHeader {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    int depth = 0;
+    int colorType = 0;
+    int channels = 0;
+    uint32_t palette[256];
+    bool hasKey = false;
+    uint32_t key[3] = {}; // tRNS color of gray and RGB images, in sample units
+};
+
+uint32_t readSample(const uint8_t* row, size_t index, int depth)
+{
+    if(depth == 8)
+        return row[index];
+    if(depth == 16)
+        return (uint32_t)row[index * 2] << 8 | row[index * 2 + 1];
+    size_t bit = index * depth;
+    return (row[bit >> 3] >> (8 - depth - (bit & 7))) & ((1 << depth) - 1);
+}
+
+uint8_t toByte(uint32_t sample, int depth)
+{
+    if(depth == 16)
+        return (uint8_t)(sample >> 8);
+    if(depth == 8)
+        return (uint8_t)sample;
+    return (uint8_t)(sample * 255 / ((1 << depth) - 1));
+}
+
+void expandRow(const PNGHeader& header, const uint8_t* row, uint8_t* output)
+{
+    uint32_t width = header.width;
+    if(header.depth == 8) {
+        if(header.colorType == 6) {
+            memcpy(output, row, (size_t)width * 4);
+            return;
+        }
+        if(header.colorType == 2 && !header.hasKey) {
+            ImageOps::convertRow(row, output, width, ImageOps::RGB);
+            return;
+        }
+        if(header.colorType == 0 && !header.hasKey) {
+            ImageOps::convertRow(row, output, width, ImageOps::Gray);
+            return;
+        }
+        if(header.colorType == 4) {
+            ImageOps::convertRow(row, output, width, ImageOps::GrayAlpha);
+            return;
+        }
+        if(header.colorType == 3) {
+            for(uint32_t x = 0; x < width; ++x)
+                memcpy(output + x * 4, &header.palette[row[x]], 4);
+            return;
+        }
+    }
+
+    for(uint32_t x = 0; x < width; ++x) {
+        uint8_t* pixel = output + x * 4;
+        switch(header.colorType) {
+        case 0: {
+            uint32_t gray = readSample(row, x, header.depth);
+            pixel[0] = pixel[1] = pixel[2] = toByte(gray, header.depth);
+            pixel[3] = header.hasKey && gray == header.key[0] ? 0 : 0xff;
+            break;
+        }
+        case 2: {
+            uint32_t rgb[3];
+            for(int c = 0; c < 3; ++c) {
+                rgb[c] = readSample(row, (size_t)x * 3 + c, header.depth);
+                pixel[c] = toByte(rgb[c], header.depth);
+            }
+            pixel[3] = header.hasKey && rgb[0] == header.key[0] && rgb[1] == header.key[1] && rgb[2] == header.key[2] ? 0 : 0xff;
+            break;
+        }
+        case 3:
+            memcpy(pixel, &header.palette[readSample(row, x, header.depth)], 4);
+            break;
+        case 4:
+            pixel[0] = pixel[1] = pixel[2] = toByte(readSample(row, (size_t)x * 2, header.depth), header.depth);
+            pixel[3] = toByte(readSample(row, (size_t)x * 2 + 1, header.depth), header.depth);
+            break;
+        default:
+            for(int c = 0; c < 4; ++c)
+                pixel[c] = toByte(readSample(row, (size_t)x * 4 + c, header.depth), header.depth);
+            break;
+        }
+    }
+}
+
+bool checkPNGFormat(int colorType, int depth)
+{
+    switch(colorType) {
+    case 0:
+        return depth == 1 || depth == 2 || depth == 4 || depth == 8 || depth == 16;
+    case 3:
+        return depth == 1 || depth == 2 || depth == 4 || depth == 8;
+    case 2:
+    case 4:
+    case 6:
+        return depth == 8 || depth == 16;
+    default:
+        return false;
+    }
+}
+
+}
+
+ImagePtr ImageDecoder::decode(const uint8_t* data, size_t size)
+{
+    if(size >= 8 && memcmp(data, "\x89PNG\r\n\x1a\n", 8) == 0)
+        return decodePNG(data, size);
+    if(size >= 4 && memcmp(data, "qoif", 4) == 0)
+        return decodeQOI(data, size);
+    SDL_Log("ImageDecoder: unknown image format.");
+    return nullptr;
+}
+
+ImagePtr ImageDecoder::decodePNG(const uint8_t* data, size_t size)
+{
+    if(size < 8 || memcmp(data, "\x89PNG\r\n\x1a\n", 8) != 0) {
+        SDL_Log("ImageDecoder: not a PNG image.");
+        return nullptr;
+    }
+
+    PNGHeader header;
+    for(int i = 0; i < 256; ++i)
+        header.palette[i] = 0xff000000;
+
+    // a single IDAT is inflated where it is, several are joined first
+    std::vector<std::pair<const uint8_t*, size_t>> chunks;
+    bool ended = false;
+    size_t position = 8;
+    while(!ended) {
+        if(size - position < 12) {
+            SDL_Log("ImageDecoder: truncated PNG.");
+            return nullptr;
+        }
+        uint32_t length = readBigEndian(data + position);
+        const uint8_t* type = data + position + 4;
+        const uint8_t* chunk = data + position + 8;
+        if(length > size - position - 12) {
+            SDL_Log("ImageDecoder: truncated PNG.");
+            return nullptr;
+        }
+        position += 12 + (size_t)length;
+
+        if(memcmp(type, "IHDR", 4) == 0) {
+            if(length < 13)
+                return nullptr;
+            header.width = readBigEndian(chunk);
+            header.height = readBigEndian(chunk + 4);
+            header.depth = chunk[8];
+            header.colorType = chunk[9];
+            if(!checkSize(header.width, header.height) || !checkPNGFormat(header.colorType, header.depth) || chunk[10] != 0 || chunk[11] != 0) {
+                SDL_Log("ImageDecoder: unsupported PNG format.");
+                return nullptr;
+            }
+            if(chunk[12] != 0) {
+                SDL_Log("ImageDecoder: interlaced PNG isn't supported.");
+                return nullptr;
+            }
+            const int channels[7] = { 1, 0, 3, 1, 2, 0, 4 };
+            header.channels = channels[header.colorType];
+        } else if(memcmp(type, "PLTE", 4) == 0) {
+            for(uint32_t i = 0; i < length / 3 && i < 256; ++i)
+                header.palette[i] = chunk[i * 3] | chunk[i * 3 + 1] << 8 | chunk[i * 3 + 2] << 16 | 0xff000000;
+        } else if(memcmp(type, "tRNS", 4) == 0) {
+            if(header.colorType == 3) {
+                for(uint32_t i = 0; i < length && i < 256; ++i)
+                    header.palette[i] = (header.palette[i] & 0x00ffffff) | (uint32_t)chunk[i] << 24;
+            } else if(header.colorType == 0 && length >= 2) {
+                header.hasKey = true;
+                header.key[0] = (uint32_t)chunk[0] << 8 | chunk[1];
+            } else if(header.colorType == 2 && length >= 6) {
+                header.hasKey = true;
+                for(int c = 0; c < 3; ++c)
+                    header.key[c] = (uint32_t)chunk[c * 2] << 8 | chunk[c * 2 + 1];
+            }
+        } else if(memcmp(type, "IDAT", 4) == 0)
+            chunks.push_back({ chunk, length });
+        else if(memcmp(type, "IEND", 4) == 0)
+            ended = true;
+    }
+
+    if(header.channels == 0 || chunks.empty()) {
+        SDL_Log("ImageDecoder: PNG without header or data.");
+        return nullptr;
+    }
+
+    std::vector<uint8_t> joined;
+    const uint8_t* compressed = chunks[0].first;
+    size_t compressedSize = chunks[0].second;
+    if(chunks.size() > 1) {
+        for(const auto& chunk : chunks)
+            joined.insert(joined.end(), chunk.first, chunk.first + chunk.second);
+        compressed = joined.data();
+        compressedSize = joined.size();
+    }
+
+    // every row is a filter byte followed by the packed samples
+    size_t bitsPerPixel = (size_t)header.channels * header.depth;
+    size_t rowBytes = (header.width * bitsPerPixel + 7) / 8;
+    size_t bpp = std::max<size_t>(bitsPerPixel / 8, 1);
+    std::vector<uint8_t> filtered(header.height * (rowBytes + 1));
+    Inflater inflater(compressed, compressedSize, filtered.data(), filtered.size());
+    if(!inflater.run()) {
+        SDL_Log("ImageDecoder: PNG data doesn't inflate to its size.");
+        return nullptr;
+    }
+
+    // rows are expanded right after unfiltering, while they are still in cache
+    std::vector<uint32_t> pixels((size_t)header.width * header.height);
+    std::vector<uint8_t> zeroRow(rowBytes, 0);
+    const uint8_t* previous = zeroRow.data();
+    for(uint32_t y = 0; y < header.height; ++y) {
+        uint8_t* row = filtered.data() + y * (rowBytes + 1);
+        if(row[0] > FilterPaeth) {
+            SDL_Log("ImageDecoder: unknown PNG filter %d.", row[0]);
+            return nullptr;
+        }
+        unfilterRow(row[0], row + 1, previous, rowBytes, bpp);
+        expandRow(header, row + 1, (uint8_t*)(pixels.data() + (size_t)y * header.width));
+        previous = row + 1;
+    }
+
+    return ImagePtr(new Image(std::move(pixels), SizeI((int)header.width, (int)header.height)));
+}
+
+ImagePtr ImageDecoder::decodeQOI(const uint8_t* data, size_t size)
+{
+    const size_t headerSize = 14;
+    const size_t endSize = 8;
+    if(size < headerSize + endSize || memcmp(data, "qoif", 4) != 0) {
+        SDL_Log("ImageDecoder: not a QOI image.");
+        return nullptr;
+    }
+
+    uint32_t width = readBigEndian(data + 4);
+    uint32_t height = readBigEndian(data + 8);
+    if(!checkSize(width, height) || (data[12] != 3 && data[12] != 4)) {
+        SDL_Log("ImageDecoder: unsupported QOI format.");
+        return nullptr;
+    }
+
+    std::vector<uint32_t> pixels((size_t)width * height);
+    uint8_t* output = (uint8_t*)pixels.data();
+    uint8_t index[64][4] = {};
+    uint8_t pixel[4] = { 0, 0, 0, 255 };
+    size_t position = headerSize;
+    size_t end = size - endSize;
+    size_t run = 0;
+
+    for(size_t i = 0; i < pixels.size(); ++i) {
+        if(run > 0)
+            run--;
+        else if(position < end) {
+            uint8_t op = data[position++];
+            if(op == 0xfe || op == 0xff) {
+                size_t channels = op == 0xfe ? 3 : 4;
+                if(end - position < channels)
+                    break;
+                memcpy(pixel, data + position, channels);
+                position += channels;
+            } else if((op & 0xc0) == 0x00)
+                memcpy(pixel, index[op], 4);
+            else if((op & 0xc0) == 0x40) {
+                pixel[0] += ((op >> 4) & 0x03) - 2;
+                pixel[1] += ((op >> 2) & 0x03) - 2;
+                pixel[2] += (op & 0x03) - 2;
+            } else if((op & 0xc0) == 0x80) {
+                if(position == end)
+                    break;
+                uint8_t second = data[position++];
+                int green = (op & 0x3f) - 32;
+                pixel[0] += green - 8 + ((second >> 4) & 0x0f);
+                pixel[1] += green;
+                pixel[2] += green - 8 + (second & 0x0f);
+            } else
+                run = op & 0x3f;
+
+            memcpy(index[(pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + pixel[3] * 11) % 64], pixel, 4);
+        }
+        memcpy(output + i * 4, pixel, 4);
+    }
+
+    return ImagePtr(new Image(std::move(pixels), SizeI((int)width, (int)height)));
+}
+
+std::vector<ImagePtr> ImageDecoder::decodeAll(ThreadPool& pool, const std::vector<Source>& sources)
+{
+    std::vector<ImagePtr> images(sources.size());
+    pool.parallelFor(sources.size(), [&](size_t i) {
+        images[i] = decode(sources[i].data, sources[i].size);
+    });
+    return images;
+}
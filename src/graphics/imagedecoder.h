@@ -0,0 +1,35 @@
+#ifndef IMAGEDECODER_H
+#define IMAGEDECODER_H
+
+#include <utils/include.h>
+
+class ThreadPool;
+
+// PNG and QOI decoding straight into RGBA8 images. Nothing is shared between calls, so any number of
+// threads may decode at once, e.g. from TextureStreamer::load or from decodeAll on a thread pool:
+//     size_t size;
+//     const uint8_t* data = pack->find("ui/button.png", &size);
+//     streamer.load([=]() { return ImageDecoder::decode(data, size); });
+// PNG supports every color type and bit depth except interlaced images.
+class ImageDecoder {
+public:
+    struct Source {
+        const uint8_t* data;
+        size_t size;
+    };
+
+    // picks the decoder by signature, nullptr if the data is neither or broken
+    static ImagePtr decode(const uint8_t* data, size_t size);
+    static ImagePtr decodePNG(const uint8_t* data, size_t size);
+    static ImagePtr decodeQOI(const uint8_t* data, size_t size);
+
+    // one image per source, in the same order, decoded across the pool's threads
+    static std::vector<ImagePtr> decodeAll(ThreadPool& pool, const std::vector<Source>& sources);
+
+    enum {
+        MaxSide = 32768,
+        MaxPixels = 1 << 28
+    };
+};
+
+#endif
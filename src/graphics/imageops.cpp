@@ -0,0 +1,504 @@
+#include "imageops.h"
+#include "image.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGEOPS_SSE2
+#include <immintrin.h>
+// AVX2 kernels are compiled for every x86 build and only called when the CPU has it
+#if defined(__GNUC__) || defined(__clang__)
+#define IMAGEOPS_AVX2 __attribute__((target("avx2")))
+#else
+#define IMAGEOPS_AVX2
+#endif
+#endif
+#if defined(__ARM_NEON)
+#define IMAGEOPS_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+#ifdef IMAGEOPS_SSE2
+bool hasAVX2()
+{
+    static const bool avx2 = SDL_HasAVX2();
+    return avx2;
+}
+
+// c * a / 255 rounded, for 16 bit lanes holding bytes
+__m128i divide255(__m128i value)
+{
+    value = _mm_add_epi16(value, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(value, _mm_srli_epi16(value, 8)), 8);
+}
+
+IMAGEOPS_AVX2 __m256i divide255(__m256i value)
+{
+    value = _mm256_add_epi16(value, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(value, _mm256_srli_epi16(value, 8)), 8);
+}
+
+IMAGEOPS_AVX2 uint32_t premultiplyAVX2(uint8_t* pixels, uint32_t count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alphaLanes = _mm256_set1_epi64x(0x00ff000000000000ll);
+    uint32_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(pixels + i * 4));
+        __m256i low = _mm256_unpacklo_epi8(x, zero);
+        __m256i high = _mm256_unpackhi_epi8(x, zero);
+        // alpha is multiplied by 255, which leaves it as it was
+        __m256i lowAlpha = _mm256_or_si256(_mm256_shufflehi_epi16(_mm256_shufflelo_epi16(low, 0xff), 0xff), alphaLanes);
+        __m256i highAlpha = _mm256_or_si256(_mm256_shufflehi_epi16(_mm256_shufflelo_epi16(high, 0xff), 0xff), alphaLanes);
+        low = divide255(_mm256_mullo_epi16(low, lowAlpha));
+        high = divide255(_mm256_mullo_epi16(high, highAlpha));
+        _mm256_storeu_si256((__m256i*)(pixels + i * 4), _mm256_packus_epi16(low, high));
+    }
+    return i;
+}
+
+IMAGEOPS_AVX2 uint32_t swapRedBlueAVX2(uint8_t* pixels, uint32_t count)
+{
+    const __m256i greenAlpha = _mm256_set1_epi32((int)0xff00ff00);
+    const __m256i low = _mm256_set1_epi32(0xff);
+    uint32_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(pixels + i * 4));
+        __m256i red = _mm256_and_si256(_mm256_srli_epi32(x, 16), low);
+        __m256i blue = _mm256_slli_epi32(_mm256_and_si256(x, low), 16);
+        x = _mm256_or_si256(_mm256_and_si256(x, greenAlpha), _mm256_or_si256(red, blue));
+        _mm256_storeu_si256((__m256i*)(pixels + i * 4), x);
+    }
+    return i;
+}
+
+IMAGEOPS_AVX2 uint32_t isOpaqueAVX2(const uint8_t* pixels, uint32_t count, bool& opaque)
+{
+    __m256i all = _mm256_set1_epi8(-1);
+    uint32_t i = 0;
+    for(; i + 8 <= count; i += 8)
+        all = _mm256_and_si256(all, _mm256_loadu_si256((const __m256i*)(pixels + i * 4)));
+    opaque = ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(all, _mm256_set1_epi8(-1))) & 0x88888888u) == 0x88888888u;
+    return i;
+}
+
+IMAGEOPS_AVX2 uint32_t expandRGBAVX2(const uint8_t* source, uint8_t* output, uint32_t width)
+{
+    // each lane gets 4 pixels, the second load overlaps so it starts on a pixel
+    const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                             0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i alpha = _mm256_set1_epi32((int)0xff000000);
+    uint32_t x = 0;
+    for(; (size_t)x * 3 + 28 <= (size_t)width * 3; x += 8) {
+        __m128i low = _mm_loadu_si128((const __m128i*)(source + x * 3));
+        __m128i high = _mm_loadu_si128((const __m128i*)(source + x * 3 + 12));
+        __m256i pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+        _mm256_storeu_si256((__m256i*)(output + x * 4), _mm256_or_si256(_mm256_shuffle_epi8(pixels, shuffle), alpha));
+    }
+    return x;
+}
+#endif
+
+void premultiplyRow(uint8_t* pixels, uint32_t count)
+{
+    uint32_t i = 0;
+#if defined(IMAGEOPS_SSE2)
+    if(hasAVX2())
+        i = premultiplyAVX2(pixels, count);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alphaLanes = _mm_set1_epi64x(0x00ff000000000000ll);
+    for(; i + 4 <= count; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(pixels + i * 4));
+        __m128i low = _mm_unpacklo_epi8(x, zero);
+        __m128i high = _mm_unpackhi_epi8(x, zero);
+        __m128i lowAlpha = _mm_or_si128(_mm_shufflehi_epi16(_mm_shufflelo_epi16(low, 0xff), 0xff), alphaLanes);
+        __m128i highAlpha = _mm_or_si128(_mm_shufflehi_epi16(_mm_shufflelo_epi16(high, 0xff), 0xff), alphaLanes);
+        low = divide255(_mm_mullo_epi16(low, lowAlpha));
+        high = divide255(_mm_mullo_epi16(high, highAlpha));
+        _mm_storeu_si128((__m128i*)(pixels + i * 4), _mm_packus_epi16(low, high));
+    }
+#elif defined(IMAGEOPS_NEON)
+    for(; i + 16 <= count; i += 16) {
+        uint8x16x4_t x = vld4q_u8(pixels + i * 4);
+        for(int c = 0; c < 3; ++c) {
+            uint16x8_t low = vmull_u8(vget_low_u8(x.val[c]), vget_low_u8(x.val[3]));
+            uint16x8_t high = vmull_u8(vget_high_u8(x.val[c]), vget_high_u8(x.val[3]));
+            low = vrsraq_n_u16(low, low, 8);
+            high = vrsraq_n_u16(high, high, 8);
+            x.val[c] = vcombine_u8(vrshrn_n_u16(low, 8), vrshrn_n_u16(high, 8));
+        }
+        vst4q_u8(pixels + i * 4, x);
+    }
+#endif
+    for(; i < count; ++i) {
+        uint8_t* pixel = pixels + i * 4;
+        for(int c = 0; c < 3; ++c) {
+            uint32_t value = pixel[c] * pixel[3] + 128;
+            pixel[c] = (uint8_t)((value + (value >> 8)) >> 8);
+        }
+    }
+}
+
+void swapRedBlueRow(uint8_t* pixels, uint32_t count)
+{
+    uint32_t i = 0;
+#if defined(IMAGEOPS_SSE2)
+    if(hasAVX2())
+        i = swapRedBlueAVX2(pixels, count);
+    const __m128i greenAlpha = _mm_set1_epi32((int)0xff00ff00);
+    const __m128i low = _mm_set1_epi32(0xff);
+    for(; i + 4 <= count; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(pixels + i * 4));
+        __m128i red = _mm_and_si128(_mm_srli_epi32(x, 16), low);
+        __m128i blue = _mm_slli_epi32(_mm_and_si128(x, low), 16);
+        _mm_storeu_si128((__m128i*)(pixels + i * 4), _mm_or_si128(_mm_and_si128(x, greenAlpha), _mm_or_si128(red, blue)));
+    }
+#elif defined(IMAGEOPS_NEON)
+    for(; i + 16 <= count; i += 16) {
+        uint8x16x4_t x = vld4q_u8(pixels + i * 4);
+        uint8x16_t red = x.val[0];
+        x.val[0] = x.val[2];
+        x.val[2] = red;
+        vst4q_u8(pixels + i * 4, x);
+    }
+#endif
+    for(; i < count; ++i)
+        std::swap(pixels[i * 4], pixels[i * 4 + 2]);
+}
+
+bool isOpaqueRow(const uint8_t* pixels, uint32_t count)
+{
+    uint32_t i = 0;
+    bool opaque = true;
+#if defined(IMAGEOPS_SSE2)
+    if(hasAVX2())
+        i = isOpaqueAVX2(pixels, count, opaque);
+    __m128i all = _mm_set1_epi8(-1);
+    for(; i + 4 <= count; i += 4)
+        all = _mm_and_si128(all, _mm_loadu_si128((const __m128i*)(pixels + i * 4)));
+    opaque = opaque && (_mm_movemask_epi8(_mm_cmpeq_epi8(all, _mm_set1_epi8(-1))) & 0x8888) == 0x8888;
+#elif defined(IMAGEOPS_NEON)
+    uint8x16_t all = vdupq_n_u8(0xff);
+    for(; i + 16 <= count; i += 16)
+        all = vandq_u8(all, vld4q_u8(pixels + i * 4).val[3]);
+    uint8x8_t half = vand_u8(vget_low_u8(all), vget_high_u8(all));
+    opaque = vget_lane_u64(vreinterpret_u64_u8(half), 0) == ~0ull;
+#endif
+    for(; i < count && opaque; ++i)
+        opaque = pixels[i * 4 + 3] == 0xff;
+    return opaque;
+}
+
+// two output pixels out of every four source pixels of two rows
+void downscaleRow(const uint8_t* row0, const uint8_t* row1, uint8_t* output, uint32_t outputWidth, uint32_t sourceWidth)
+{
+    uint32_t x = 0;
+#if defined(IMAGEOPS_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for(; x + 2 <= outputWidth && x * 2 + 4 <= sourceWidth; x += 2) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(row0 + x * 8));
+        __m128i b = _mm_loadu_si128((const __m128i*)(row1 + x * 8));
+        __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+        __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+        __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(low, high), _mm_unpackhi_epi64(low, high));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+        _mm_storel_epi64((__m128i*)(output + x * 4), _mm_packus_epi16(sum, sum));
+    }
+#elif defined(IMAGEOPS_NEON)
+    for(; x + 2 <= outputWidth && x * 2 + 4 <= sourceWidth; x += 2) {
+        uint8x16_t a = vld1q_u8(row0 + x * 8);
+        uint8x16_t b = vld1q_u8(row1 + x * 8);
+        uint16x8_t low = vaddl_u8(vget_low_u8(a), vget_low_u8(b));
+        uint16x8_t high = vaddl_u8(vget_high_u8(a), vget_high_u8(b));
+        uint16x8_t sum = vcombine_u16(vadd_u16(vget_low_u16(low), vget_high_u16(low)), vadd_u16(vget_low_u16(high), vget_high_u16(high)));
+        vst1_u8(output + x * 4, vrshrn_n_u16(sum, 2));
+    }
+#endif
+    for(; x < outputWidth; ++x) {
+        uint32_t x0 = std::min(x * 2, sourceWidth - 1) * 4;
+        uint32_t x1 = std::min(x * 2 + 1, sourceWidth - 1) * 4;
+        for(int c = 0; c < 4; ++c)
+            output[x * 4 + c] = (uint8_t)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+    }
+}
+
+struct BilinearTap {
+    uint32_t index; // the first of the two sampled pixels or rows
+    uint32_t weight; // of the second, 0 to 256
+};
+
+// pixel centers map onto each other; at the far edge the second sample takes all the weight
+std::vector<BilinearTap> bilinearTaps(uint32_t sourceSize, uint32_t size)
+{
+    std::vector<BilinearTap> taps(size);
+    for(uint32_t i = 0; i < size; ++i) {
+        int64_t position = ((int64_t)(2 * i + 1) * sourceSize * 256) / (2 * (int64_t)size) - 128;
+        position = std::max<int64_t>(position, 0);
+        uint32_t index = (uint32_t)(position >> 8);
+        uint32_t weight = (uint32_t)(position & 255);
+        if(sourceSize == 1) {
+            index = 0;
+            weight = 0;
+        } else if(index >= sourceSize - 1) {
+            index = sourceSize - 2;
+            weight = 256;
+        }
+        taps[i] = { index, weight };
+    }
+    return taps;
+}
+
+void bilinearRow(const uint8_t* row0, const uint8_t* row1, uint32_t rowWeight, const std::vector<BilinearTap>& columns,
+                 uint32_t sourceWidth, uint8_t* output)
+{
+    uint32_t x = 0;
+    // pairs of neighbours are read as 8 bytes, which a single column image doesn't have
+    if(sourceWidth > 1) {
+#if defined(IMAGEOPS_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi16(128);
+        const __m128i weight0 = _mm_set1_epi16((short)(256 - rowWeight));
+        const __m128i weight1 = _mm_set1_epi16((short)rowWeight);
+        for(; x < columns.size(); ++x) {
+            const BilinearTap& tap = columns[x];
+            __m128i weights = _mm_setr_epi16((short)(256 - tap.weight), (short)(256 - tap.weight), (short)(256 - tap.weight), (short)(256 - tap.weight),
+                                             (short)tap.weight, (short)tap.weight, (short)tap.weight, (short)tap.weight);
+            __m128i top = _mm_mullo_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(row0 + tap.index * 4)), zero), weights);
+            __m128i bottom = _mm_mullo_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(row1 + tap.index * 4)), zero), weights);
+            top = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(top, _mm_srli_si128(top, 8)), round), 8);
+            bottom = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(bottom, _mm_srli_si128(bottom, 8)), round), 8);
+            __m128i value = _mm_add_epi16(_mm_mullo_epi16(top, weight0), _mm_mullo_epi16(bottom, weight1));
+            value = _mm_srli_epi16(_mm_add_epi16(value, round), 8);
+            int pixel = _mm_cvtsi128_si32(_mm_packus_epi16(value, value));
+            memcpy(output + x * 4, &pixel, 4);
+        }
+#elif defined(IMAGEOPS_NEON)
+        for(; x < columns.size(); ++x) {
+            const BilinearTap& tap = columns[x];
+            uint16x8_t weights = vcombine_u16(vdup_n_u16((uint16_t)(256 - tap.weight)), vdup_n_u16((uint16_t)tap.weight));
+            uint16x8_t top = vmulq_u16(vmovl_u8(vld1_u8(row0 + tap.index * 4)), weights);
+            uint16x8_t bottom = vmulq_u16(vmovl_u8(vld1_u8(row1 + tap.index * 4)), weights);
+            uint16x4_t top4 = vrshr_n_u16(vadd_u16(vget_low_u16(top), vget_high_u16(top)), 8);
+            uint16x4_t bottom4 = vrshr_n_u16(vadd_u16(vget_low_u16(bottom), vget_high_u16(bottom)), 8);
+            uint16x4_t value = vmla_n_u16(vmul_n_u16(top4, (uint16_t)(256 - rowWeight)), bottom4, (uint16_t)rowWeight);
+            uint8x8_t pixel = vmovn_u16(vcombine_u16(vrshr_n_u16(value, 8), vdup_n_u16(0)));
+            vst1_lane_u32((uint32_t*)(output + x * 4), vreinterpret_u32_u8(pixel), 0);
+        }
+#endif
+    }
+
+    for(; x < columns.size(); ++x) {
+        const BilinearTap& tap = columns[x];
+        uint32_t x0 = tap.index * 4;
+        uint32_t x1 = std::min(tap.index + 1, sourceWidth - 1) * 4;
+        for(int c = 0; c < 4; ++c) {
+            uint32_t top = (row0[x0 + c] * (256 - tap.weight) + row0[x1 + c] * tap.weight + 128) >> 8;
+            uint32_t bottom = (row1[x0 + c] * (256 - tap.weight) + row1[x1 + c] * tap.weight + 128) >> 8;
+            output[x * 4 + c] = (uint8_t)((top * (256 - rowWeight) + bottom * rowWeight + 128) >> 8);
+        }
+    }
+}
+
+}
+
+int ImageOps::getBytesPerPixel(PixelFormat format)
+{
+    switch(format) {
+    case RGB:
+    case BGR:
+        return 3;
+    case Gray:
+        return 1;
+    case GrayAlpha:
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+bool ImageOps::clip(const Image& image, const RectI& rect, RectI& clipped)
+{
+    if(image.getFormat() != SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM) {
+        SDL_Log("ImageOps: only RGBA8 images can be processed.");
+        return false;
+    }
+    RectI bounds(0, 0, image.getSize());
+    clipped = rect.isValid() ? rect.intersection(bounds) : bounds;
+    return clipped.isValid();
+}
+
+void ImageOps::premultiplyAlpha(Image& image, const RectI& rect)
+{
+    RectI area;
+    if(!clip(image, rect, area))
+        return;
+    for(int y = area.top(); y <= area.bottom(); ++y)
+        premultiplyRow(image.getPixelData(area.x(), y), area.width());
+}
+
+void ImageOps::swapRedBlue(Image& image, const RectI& rect)
+{
+    RectI area;
+    if(!clip(image, rect, area))
+        return;
+    for(int y = area.top(); y <= area.bottom(); ++y)
+        swapRedBlueRow(image.getPixelData(area.x(), y), area.width());
+}
+
+void ImageOps::flipVertical(Image& image, const RectI& rect)
+{
+    RectI area;
+    if(!clip(image, rect, area))
+        return;
+
+    size_t rowBytes = (size_t)area.width() * 4;
+    std::vector<uint8_t> scratch(rowBytes);
+    for(int top = area.top(), bottom = area.bottom(); top < bottom; ++top, --bottom) {
+        uint8_t* topRow = image.getPixelData(area.x(), top);
+        uint8_t* bottomRow = image.getPixelData(area.x(), bottom);
+        memcpy(scratch.data(), topRow, rowBytes);
+        memcpy(topRow, bottomRow, rowBytes);
+        memcpy(bottomRow, scratch.data(), rowBytes);
+    }
+}
+
+bool ImageOps::isOpaque(const Image& image, const RectI& rect)
+{
+    RectI area;
+    if(!clip(image, rect, area))
+        return false;
+    for(int y = area.top(); y <= area.bottom(); ++y) {
+        if(!isOpaqueRow(image.getPixelData(area.x(), y), area.width()))
+            return false;
+    }
+    return true;
+}
+
+void ImageOps::convertRow(const uint8_t* source, uint8_t* output, uint32_t width, PixelFormat format)
+{
+    uint32_t x = 0;
+    switch(format) {
+    case RGBA:
+        memcpy(output, source, (size_t)width * 4);
+        return;
+    case BGRA:
+        memcpy(output, source, (size_t)width * 4);
+        swapRedBlueRow(output, width);
+        return;
+    case RGB:
+    case BGR:
+#if defined(IMAGEOPS_SSE2)
+        if(hasAVX2())
+            x = expandRGBAVX2(source, output, width);
+#elif defined(IMAGEOPS_NEON)
+        for(; x + 16 <= width; x += 16) {
+            uint8x16x3_t rgb = vld3q_u8(source + x * 3);
+            uint8x16x4_t rgba = { { rgb.val[0], rgb.val[1], rgb.val[2], vdupq_n_u8(0xff) } };
+            vst4q_u8(output + x * 4, rgba);
+        }
+#endif
+        for(; x < width; ++x) {
+            output[x * 4 + 0] = source[x * 3 + 0];
+            output[x * 4 + 1] = source[x * 3 + 1];
+            output[x * 4 + 2] = source[x * 3 + 2];
+            output[x * 4 + 3] = 0xff;
+        }
+        if(format == BGR)
+            swapRedBlueRow(output, width);
+        return;
+    case Gray:
+#if defined(IMAGEOPS_SSE2)
+        for(; x + 16 <= width; x += 16) {
+            __m128i gray = _mm_loadu_si128((const __m128i*)(source + x));
+            __m128i opaque = _mm_set1_epi8(-1);
+            __m128i grayGray = _mm_unpacklo_epi8(gray, gray);
+            __m128i grayAlpha = _mm_unpacklo_epi8(gray, opaque);
+            _mm_storeu_si128((__m128i*)(output + x * 4), _mm_unpacklo_epi16(grayGray, grayAlpha));
+            _mm_storeu_si128((__m128i*)(output + x * 4 + 16), _mm_unpackhi_epi16(grayGray, grayAlpha));
+            grayGray = _mm_unpackhi_epi8(gray, gray);
+            grayAlpha = _mm_unpackhi_epi8(gray, opaque);
+            _mm_storeu_si128((__m128i*)(output + x * 4 + 32), _mm_unpacklo_epi16(grayGray, grayAlpha));
+            _mm_storeu_si128((__m128i*)(output + x * 4 + 48), _mm_unpackhi_epi16(grayGray, grayAlpha));
+        }
+#elif defined(IMAGEOPS_NEON)
+        for(; x + 16 <= width; x += 16) {
+            uint8x16_t gray = vld1q_u8(source + x);
+            uint8x16x4_t rgba = { { gray, gray, gray, vdupq_n_u8(0xff) } };
+            vst4q_u8(output + x * 4, rgba);
+        }
+#endif
+        for(; x < width; ++x) {
+            output[x * 4 + 0] = output[x * 4 + 1] = output[x * 4 + 2] = source[x];
+            output[x * 4 + 3] = 0xff;
+        }
+        return;
+    case GrayAlpha:
+#if defined(IMAGEOPS_SSE2)
+        for(; x + 8 <= width; x += 8) {
+            __m128i grayAlpha = _mm_loadu_si128((const __m128i*)(source + x * 2));
+            __m128i grayGray = _mm_or_si128(_mm_and_si128(grayAlpha, _mm_set1_epi16(0xff)), _mm_slli_epi16(grayAlpha, 8));
+            _mm_storeu_si128((__m128i*)(output + x * 4), _mm_unpacklo_epi16(grayGray, grayAlpha));
+            _mm_storeu_si128((__m128i*)(output + x * 4 + 16), _mm_unpackhi_epi16(grayGray, grayAlpha));
+        }
+#elif defined(IMAGEOPS_NEON)
+        for(; x + 16 <= width; x += 16) {
+            uint8x16x2_t grayAlpha = vld2q_u8(source + x * 2);
+            uint8x16x4_t rgba = { { grayAlpha.val[0], grayAlpha.val[0], grayAlpha.val[0], grayAlpha.val[1] } };
+            vst4q_u8(output + x * 4, rgba);
+        }
+#endif
+        for(; x < width; ++x) {
+            output[x * 4 + 0] = output[x * 4 + 1] = output[x * 4 + 2] = source[x * 2];
+            output[x * 4 + 3] = source[x * 2 + 1];
+        }
+        return;
+    }
+}
+
+ImagePtr ImageOps::convert(const uint8_t* pixels, uint32_t pitch, const SizeI& size, PixelFormat format)
+{
+    if(!pixels || !size.isValid() || size.area() == 0)
+        return nullptr;
+
+    ImagePtr image = ImagePtr(new Image(size));
+    for(int y = 0; y < size.h; ++y)
+        convertRow(pixels + (size_t)y * pitch, image->getPixelData(0, y), (uint32_t)size.w, format);
+    return image;
+}
+
+ImagePtr ImageOps::downscaleBox(const Image& image, const RectI& rect)
+{
+    RectI area;
+    if(!clip(image, rect, area))
+        return nullptr;
+
+    SizeI size(std::max(area.width() / 2, 1), std::max(area.height() / 2, 1));
+    ImagePtr result = ImagePtr(new Image(size));
+    for(int y = 0; y < size.h; ++y) {
+        int y0 = std::min(y * 2, area.height() - 1);
+        int y1 = std::min(y * 2 + 1, area.height() - 1);
+        downscaleRow(image.getPixelData(area.x(), area.y() + y0), image.getPixelData(area.x(), area.y() + y1),
+                     result->getPixelData(0, y), (uint32_t)size.w, (uint32_t)area.width());
+    }
+    return result;
+}
+
+ImagePtr ImageOps::scaleBilinear(const Image& image, const SizeI& size, const RectI& rect)
+{
+    RectI area;
+    if(!clip(image, rect, area) || size.w <= 0 || size.h <= 0)
+        return nullptr;
+
+    std::vector<BilinearTap> columns = bilinearTaps((uint32_t)area.width(), (uint32_t)size.w);
+    std::vector<BilinearTap> rows = bilinearTaps((uint32_t)area.height(), (uint32_t)size.h);
+    ImagePtr result = ImagePtr(new Image(size));
+    for(int y = 0; y < size.h; ++y) {
+        const BilinearTap& tap = rows[y];
+        uint32_t y1 = std::min(tap.index + 1, (uint32_t)area.height() - 1);
+        bilinearRow(image.getPixelData(area.x(), area.y() + tap.index), image.getPixelData(area.x(), area.y() + y1),
+                    tap.weight, columns, (uint32_t)area.width(), result->getPixelData(0, y));
+    }
+    return result;
+}
@@ -0,0 +1,45 @@
+#ifndef IMAGEOPS_H
+#define IMAGEOPS_H
+
+#include <utils/include.h>
+#include <utils/rect.h>
+#include <utils/size.h>
+
+// Whole image operations on RGBA8 images, vectorized with SSE2, AVX2 (picked at runtime) or NEON.
+// Operations taking a rect only touch that part of the image, an invalid rect means all of it.
+// Compressed images are left alone.
+class ImageOps {
+public:
+    enum PixelFormat {
+        RGBA,
+        BGRA,
+        RGB,
+        BGR,
+        Gray,
+        GrayAlpha
+    };
+
+    static int getBytesPerPixel(PixelFormat format);
+
+    // color channels multiplied by alpha, for blending with premultiplied blend modes
+    static void premultiplyAlpha(Image& image, const RectI& rect = RectI());
+    // exchanges red and blue, which turns RGBA into BGRA and back
+    static void swapRedBlue(Image& image, const RectI& rect = RectI());
+    static void flipVertical(Image& image, const RectI& rect = RectI());
+    static bool isOpaque(const Image& image, const RectI& rect = RectI());
+
+    // pixels rows pitch bytes apart, in format, as a new RGBA8 image
+    static ImagePtr convert(const uint8_t* pixels, uint32_t pitch, const SizeI& size, PixelFormat format);
+    static void convertRow(const uint8_t* source, uint8_t* output, uint32_t width, PixelFormat format);
+
+    // half the size, every pixel the average of a 2x2 block; odd edges reuse their last row or column
+    static ImagePtr downscaleBox(const Image& image, const RectI& rect = RectI());
+    // any size, sampling between the four nearest pixels; shrinking by more than half skips pixels,
+    // downscaleBox first keeps that from aliasing
+    static ImagePtr scaleBilinear(const Image& image, const SizeI& size, const RectI& rect = RectI());
+
+private:
+    static bool clip(const Image& image, const RectI& rect, RectI& clipped);
+};
+
+#endif
@@ -5,11 +5,13 @@
 #include "engine.h"
 #include "painter.h"
 #include "framebuffer.h"
-#include "renderbuffer.h"
 
 #include <graphics/texture/texture.h>
+#include <graphics/image.h>
 #include <ui/ui.h>
 
+#include <algorithm>
+
 static SDL_GPUShaderFormat g_shaderFormats = SDL_GPU_SHADERFORMAT_SPIRV | SDL_GPU_SHADERFORMAT_DXBC | SDL_GPU_SHADERFORMAT_DXIL | SDL_GPU_SHADERFORMAT_METALLIB;
 
 bool Painter::create()
@@ -56,24 +58,142 @@ bool Painter::create()
     SDL_SetGPUAllowedFramesInFlight(m_gpuDevice, FramesInFlight);
 
     m_frameBuffers.reserve(32);
-    m_frameBuffers[0] = std::make_shared<BufferManager>();
-    m_states.resize(1);
-
+    m_frameBuffers[0] = std::make_shared<BufferManager>(true);
     reset();
 
-    return g_programs.init(m_gpuDriver);
+    if(!createStaticBuffers())
+        return false;
+
+    if(!g_programs.init(m_gpuDriver))
+        return false;
+
+    m_textureStreamer.start(m_threadPool);
+
+    if(m_threadedRendering && SDL_GetCPUCount() > 1 && !startRenderThread()) {
+        stopRenderThread();
+        SDL_Log("Falling back to rendering on the main thread.");
+    }
+    return true;
 }
 
 void Painter::destroy()
 {
+    stopRenderThread();
+    m_textureStreamer.stop();
+    SDL_WaitForGPUIdle(m_gpuDevice);
+    for(FramePacket& packet : m_packets)
+        recyclePacket(packet);
+    m_bufferManagerPool.clear();
     m_frameBuffers.clear();
+    m_renderTargetPool.clear();
+    m_textureAtlas.clear();
+    m_uploadBuffer.release();
+    m_stagingPool.release();
     g_programs.clear();
     FrameBuffer::destroyTemporaryFrameBuffer();
+    if(m_quadIndexBuffer) {
+        SDL_ReleaseGPUBuffer(m_gpuDevice, m_quadIndexBuffer);
+        m_quadIndexBuffer = nullptr;
+    }
+    if(m_quadCornerBuffer) {
+        SDL_ReleaseGPUBuffer(m_gpuDevice, m_quadCornerBuffer);
+        m_quadCornerBuffer = nullptr;
+    }
     SDL_ReleaseWindowFromGPUDevice(m_gpuDevice, g_window->getSDLWindow());
     SDL_DestroyGPUDevice(m_gpuDevice);
     m_gpuDevice = nullptr;
 }
 
+bool Painter::createStaticBuffers()
+{
+    // every quad is 0,1,2 2,1,3 over its own 4 vertices; built once and shared by all indexed draws
+    std::vector<uint16_t> indices(MaxIndexedQuads * 6);
+    for(uint32_t i = 0; i < MaxIndexedQuads; ++i) {
+        uint16_t vertex = (uint16_t)(i * 4);
+        indices[i*6+0] = vertex + 0;
+        indices[i*6+1] = vertex + 1;
+        indices[i*6+2] = vertex + 2;
+        indices[i*6+3] = vertex + 2;
+        indices[i*6+4] = vertex + 1;
+        indices[i*6+5] = vertex + 3;
+    }
+
+    m_quadIndexBuffer = createStaticBuffer(SDL_GPU_BUFFERUSAGE_INDEX, indices.data(), (uint32_t)(indices.size() * sizeof(uint16_t)));
+    if(!m_quadIndexBuffer)
+        return false;
+
+    // unit corners expanded by the instanced rect program, in triangle strip order
+    static const float corners[] = {
+        0.0f, 0.0f,
+        1.0f, 0.0f,
+        0.0f, 1.0f,
+        1.0f, 1.0f
+    };
+
+    m_quadCornerBuffer = createStaticBuffer(SDL_GPU_BUFFERUSAGE_VERTEX, corners, (uint32_t)sizeof(corners));
+    return m_quadCornerBuffer != nullptr;
+}
+
+SDL_GPUBuffer* Painter::createStaticBuffer(SDL_GPUBufferUsageFlags usage, const void* data, uint32_t size)
+{
+    SDL_GPUBufferCreateInfo bufferInfo;
+    SDL_zero(bufferInfo);
+    bufferInfo.usage = usage;
+    bufferInfo.size = size;
+
+    SDL_GPUBuffer* buffer = SDL_CreateGPUBuffer(m_gpuDevice, &bufferInfo);
+    if(!buffer) {
+        SDL_Log("SDL_CreateGPUBuffer: %s", SDL_GetError());
+        return nullptr;
+    }
+
+    SDL_GPUTransferBufferCreateInfo tbInfo;
+    SDL_zero(tbInfo);
+    tbInfo.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
+    tbInfo.size = size;
+
+    SDL_GPUTransferBuffer* transferBuffer = SDL_CreateGPUTransferBuffer(m_gpuDevice, &tbInfo);
+    if(!transferBuffer) {
+        SDL_Log("Error transfering buffer: %s", SDL_GetError());
+        SDL_ReleaseGPUBuffer(m_gpuDevice, buffer);
+        return nullptr;
+    }
+
+    void* map = SDL_MapGPUTransferBuffer(m_gpuDevice, transferBuffer, false);
+    if(!map) {
+        SDL_Log("SDL_MapGPUTransferBuffer: %s", SDL_GetError());
+        SDL_ReleaseGPUTransferBuffer(m_gpuDevice, transferBuffer);
+        SDL_ReleaseGPUBuffer(m_gpuDevice, buffer);
+        return nullptr;
+    }
+    memcpy(map, data, size);
+    SDL_UnmapGPUTransferBuffer(m_gpuDevice, transferBuffer);
+
+    SDL_GPUCommandBuffer* commandBuffer = SDL_AcquireGPUCommandBuffer(m_gpuDevice);
+    if(!commandBuffer) {
+        SDL_ReleaseGPUTransferBuffer(m_gpuDevice, transferBuffer);
+        SDL_ReleaseGPUBuffer(m_gpuDevice, buffer);
+        return nullptr;
+    }
+
+    SDL_GPUCopyPass* copyPass = SDL_BeginGPUCopyPass(commandBuffer);
+
+    SDL_GPUTransferBufferLocation loc;
+    loc.transfer_buffer = transferBuffer;
+    loc.offset = 0;
+
+    SDL_GPUBufferRegion dest;
+    dest.buffer = buffer;
+    dest.offset = 0;
+    dest.size = size;
+
+    SDL_UploadToGPUBuffer(copyPass, &loc, &dest, false);
+    SDL_EndGPUCopyPass(copyPass);
+    SDL_SubmitGPUCommandBuffer(commandBuffer);
+    SDL_ReleaseGPUTransferBuffer(m_gpuDevice, transferBuffer);
+    return buffer;
+}
+
 void Painter::genFrameBuffer(uint32_t* fboId)
 {
     if(!fboId)
@@ -86,7 +206,7 @@ void Painter::genFrameBuffer(uint32_t* fboId)
         newId = ++m_fboController;
 
     *fboId = newId;
-    m_frameBuffers[*fboId] = std::make_shared<BufferManager>();
+    m_frameBuffers[*fboId] = std::make_shared<BufferManager>(true);
 }
 
 void Painter::deleteFrameBuffer(uint32_t* fboId)
@@ -112,23 +232,50 @@ void Painter::setFrameBufferTexture(uint32_t fboId, const TexturePtr &texture)
 
 PainterState* Painter::getCurrentState()
 {
-    bool newState = false;
-    if(m_painterFlags != 0) {
-        ++m_stateId;
-        newState = true;
-    }
-    
-    if(m_stateId >= m_states.size())
-        m_states.resize(m_stateId * 2);
+    return getRecordingContext().getCurrentState();
+}
 
-    PainterState& state = m_states[m_stateId];
-    if(newState) {
-        state.copy(m_state);
-        state.id = m_stateId;
-        state.flags = m_painterFlags;
-        m_painterFlags = 0;
-    }
-    return &state;
+void Painter::drawRetained(const RetainedGeometry& geometry)
+{
+    const RetainedBlockPtr& block = geometry.getBlock();
+    if(!block || !block->buffer)
+        return;
+
+    // only the block's few states are interned again, its vertices are not touched
+    static thread_local std::vector<size_t> stateRemap;
+    remapStates(block->states, stateRemap);
+    getRecordBuffer()->addRetained(block, stateRemap);
+}
+
+void Painter::splice(const RecordingContext& context)
+{
+    BufferManager* bufferManager = context.getBufferManager();
+    BufferManager* recordBuffer = getRecordBuffer();
+    if(!bufferManager || !recordBuffer)
+        return;
+
+    static thread_local std::vector<size_t> stateRemap;
+    remapStates(context.getStates(), stateRemap);
+    recordBuffer->append(*bufferManager, stateRemap);
+}
+
+void Painter::splice(const DisplayList& displayList, const PointF& translation)
+{
+    BufferManager* recordBuffer = getRecordBuffer();
+    if(displayList.empty() || !recordBuffer)
+        return;
+
+    static thread_local std::vector<size_t> stateRemap;
+    remapStates(displayList.states, stateRemap);
+    recordBuffer->append(displayList, stateRemap, translation);
+}
+
+void Painter::remapStates(const std::vector<PainterState>& states, std::vector<size_t>& stateRemap)
+{
+    RecordingContext& context = getRecordingContext();
+    stateRemap.resize(states.size());
+    for(size_t i = 0; i < states.size(); ++i)
+        stateRemap[i] = context.internState(states[i]);
 }
 
 void Painter::translate(float x, float y)
@@ -139,27 +286,26 @@ void Painter::translate(float x, float y)
            x,    y, 1.0f
     };
 
-    setTransformMatrix(m_state.transformMatrix * translateMatrix);
+    setTransformMatrix(getRecordingContext().getState().transformMatrix * translateMatrix);
 }
 
 void Painter::setColor(const Color &color)
 {
-    if(m_state.color == color)
-        return;
-    m_state.color = color;
-    m_painterFlags |= MustUpdateColor;
+    // color is written into every vertex at record time, so it never needs a new state
+    getRecordingContext().getState().color = color;
 }
 
 SizeI Painter::getResolution() const
 {
-    return m_state.resolution;
+    return getRecordingContext().getState().resolution;
 }
 
 void Painter::setResolution(const SizeI &resolution)
 {
-    if(m_state.resolution == resolution)
+    PainterState& state = getRecordingContext().getState();
+    if(state.resolution == resolution)
         return;
-    m_state.resolution = resolution;
+    state.resolution = resolution;
     resetProjectionMatrix();
 }
 
@@ -173,10 +319,11 @@ void Painter::setViewport(const RectI&)
 
 void Painter::setBlendMode(BlendMode blendMode)
 {
-    if(m_state.blendMode == blendMode)
+    RecordingContext& context = getRecordingContext();
+    if(context.getState().blendMode == blendMode)
         return;
-    m_state.blendMode = blendMode;
-    m_painterFlags |= MustUpdateBlendMode;
+    context.getState().blendMode = blendMode;
+    context.markDirty(MustUpdateBlendMode);
 }
 
 void Painter::reset()
@@ -193,8 +340,9 @@ void Painter::refresh()
 
 void Painter::resetProjectionMatrix()
 {
-    float dx = 2.0f / m_state.resolution.w;
-    float dy = 2.0f / m_state.resolution.h;
+    const SizeI& resolution = getRecordingContext().getState().resolution;
+    float dx = 2.0f / resolution.w;
+    float dy = 2.0f / resolution.h;
 
     setProjectionMatrix({
         dx,                       0.0f,                      0.0f,
@@ -210,23 +358,25 @@ void Painter::resetTransformMatrix()
 
 void Painter::setProjectionMatrix(const Matrix3 &projectionMatrix)
 {
-    if(m_state.projectionMatrix == projectionMatrix)
+    RecordingContext& context = getRecordingContext();
+    if(context.getState().projectionMatrix == projectionMatrix)
         return;
-    m_state.projectionMatrix = projectionMatrix;
-    m_painterFlags |= MustUpdateProjectionTransformMatrix;
+    context.getState().projectionMatrix = projectionMatrix;
+    context.markDirty(MustUpdateProjectionTransformMatrix);
 }
 
 void Painter::setTransformMatrix(const Matrix3& transformMatrix)
 {
-    if(m_state.transformMatrix == transformMatrix)
+    RecordingContext& context = getRecordingContext();
+    if(context.getState().transformMatrix == transformMatrix)
         return;
-    m_state.transformMatrix = transformMatrix;
-    m_painterFlags |= MustUpdateProjectionTransformMatrix;
+    context.getState().transformMatrix = transformMatrix;
+    context.markDirty(MustUpdateProjectionTransformMatrix);
 }
 
 void Painter::drawPoint(const PointF& point)
 {
-    static std::vector<PointF> points(1);
+    thread_local std::vector<PointF> points(1);
     points[0].x = point.x;
     points[0].y = point.y;
     drawPoints(points);
@@ -234,13 +384,15 @@ void Painter::drawPoint(const PointF& point)
 
 void Painter::drawPoints(const std::vector<PointF>& points)
 {
-    auto* vertexData = m_frameBuffers[m_currentFBO]->add<SolidVertexBuffer>(points.size(), PrimitiveTypePointList, getCurrentState());
+    auto* vertexData = getRecordBuffer()->add<SolidVertexBuffer>(points.size(), PrimitiveTypePointList, getCurrentState(), DrawBounds::of(points));
 
+    uint32_t color = getRecordingContext().getState().color.rgba();
     for(uint32_t i = 0; i < points.size(); ++i) {
         auto& d = vertexData[i];
         const PointF& p = points[i];
         d.x = p.x;
         d.y = p.y;
+        d.color = color;
     }
 }
 
@@ -254,7 +406,7 @@ void Painter::drawPoints(const std::vector<PointI>& points)
 
 void Painter::drawLine(const PointF &a, const PointF &b)
 {
-    static std::vector<PointF> lines(2);
+    thread_local std::vector<PointF> lines(2);
     lines[0] = a;
     lines[1] = b;
     drawLines(lines);
@@ -262,12 +414,14 @@ void Painter::drawLine(const PointF &a, const PointF &b)
 
 void Painter::drawLines(const std::vector<PointF> &lines)
 {
-    auto* vertexData = m_frameBuffers[m_currentFBO]->add<SolidVertexBuffer>(lines.size(), PrimitiveTypeLineList, getCurrentState());
+    auto* vertexData = getRecordBuffer()->add<SolidVertexBuffer>(lines.size(), PrimitiveTypeLineList, getCurrentState(), DrawBounds::of(lines));
+    uint32_t color = getRecordingContext().getState().color.rgba();
     for(uint32_t i = 0; i < lines.size(); ++i) {
         auto& d = vertexData[i];
         const PointF& p = lines[i];
         d.x = p.x;
         d.y = p.y;
+        d.color = color;
     }
 }
 
@@ -281,12 +435,22 @@ void Painter::drawLines(const std::vector<PointI>& lines)
 
 void Painter::drawLineStrip(const std::vector<PointF> &lines)
 {
-    auto* vertexData = m_frameBuffers[m_currentFBO]->add<SolidVertexBuffer>(lines.size(), PrimitiveTypeLineStrip, getCurrentState());
-    for(uint32_t i = 0; i < lines.size(); ++i) {
-        auto& d = vertexData[i];
-        const PointF& p = lines[i];
-        d.x = p.x;
-        d.y = p.y;
+    if(lines.size() < 2)
+        return;
+
+    // emitted as a line list so consecutive strips can be batched together
+    size_t segments = lines.size() - 1;
+    auto* vertexData = getRecordBuffer()->add<SolidVertexBuffer>(segments * 2, PrimitiveTypeLineList, getCurrentState(), DrawBounds::of(lines));
+    uint32_t color = getRecordingContext().getState().color.rgba();
+    for(uint32_t i = 0; i < segments; ++i) {
+        const PointF& a = lines[i];
+        const PointF& b = lines[i + 1];
+        vertexData[i*2+0].x = a.x;
+        vertexData[i*2+0].y = a.y;
+        vertexData[i*2+0].color = color;
+        vertexData[i*2+1].x = b.x;
+        vertexData[i*2+1].y = b.y;
+        vertexData[i*2+1].color = color;
     }
 }
 
@@ -300,7 +464,7 @@ void Painter::drawLineStrip(const std::vector<PointI> &lines)
 
 void Painter::drawTriangle(const PointF& a, const PointF& b, const PointF& c)
 {
-    static std::vector<PointF> points(4);
+    thread_local std::vector<PointF> points(4);
     points[0] = a;
     points[1] = b;
     points[2] = c;
@@ -332,7 +496,7 @@ void Painter::drawTriangles(const std::vector<PointI>& points, TriangleDrawMode
 
 void Painter::drawFilledTriangle(const PointF &a, const PointF &b, const PointF &c)
 {
-    static std::vector<PointF> points(3);
+    thread_local std::vector<PointF> points(3);
     points[0] = a;
     points[1] = b;
     points[2] = c;
@@ -341,40 +505,42 @@ void Painter::drawFilledTriangle(const PointF &a, const PointF &b, const PointF
 
 void Painter::drawFilledTriangles(const std::vector<PointF> &points, TriangleDrawMode mode)
 {
-    if(mode == DrawTriangleFan) {
+    // fans and strips are unrolled to lists so they can share a draw with the surrounding geometry
+    size_t count = points.size();
+    if(mode != DrawTriangles) {
         if(points.size() < 3)
             return;
-
-        uint32_t count = (uint32_t)points.size() - 2;
-        std::vector<PointF> triangles(count * 3);
-        for(uint32_t i = 0; i < count; ++i) {
-            triangles[i * 3 + 0] = points[0];
-            triangles[i * 3 + 1] = points[i + 1];
-            triangles[i * 3 + 2] = points[i + 2];
-        }
-
-        drawFilledTriangles(triangles, DrawTriangles);
-        return;
+        count = (points.size() - 2) * 3;
     }
 
-    PrimitiveType primitiveType = PrimitiveTypeTriangleList;
-    if(mode == DrawTriangleStrip)
-        primitiveType = PrimitiveTypeTriangleStrip;
-    else if(mode == DrawTriangles)
-        primitiveType = PrimitiveTypeTriangleList;
+    auto* vertexData = getRecordBuffer()->add<SolidVertexBuffer>(count, PrimitiveTypeTriangleList, getCurrentState(), DrawBounds::of(points));
+    uint32_t color = getRecordingContext().getState().color.rgba();
+    for(uint32_t i = 0; i < count; ++i) {
+        const PointF* point;
+        if(mode == DrawTriangles)
+            point = &points[i];
+        else {
+            uint32_t triangle = i / 3;
+            uint32_t corner = i % 3;
+            if(mode == DrawTriangleFan)
+                point = corner == 0 ? &points[0] : &points[triangle + corner];
+            else if((triangle % 2) != 0 && corner != 0)
+                point = &points[triangle + 3 - corner];
+            else
+                point = &points[triangle + corner];
+        }
 
-    auto* vertexData = m_frameBuffers[m_currentFBO]->add<SolidVertexBuffer>(points.size(), primitiveType, getCurrentState());
-    for(uint32_t i = 0; i < points.size(); ++i) {
         auto& d = vertexData[i];
-        const PointF& point = points[i];
-        d.x = point.x;
-        d.y = point.y;
+        d.x = point->x;
+        d.y = point->y;
+        d.color = color;
     }
 }
 
 void Painter::drawFilledTriangles(const std::vector<PointI> &points, TriangleDrawMode mode)
 {
-    std::vector<PointF> pointsF(points.size());
+    thread_local std::vector<PointF> pointsF;
+    pointsF.resize(points.size());
     for(uint32_t i = 0; i < points.size(); ++i)
         pointsF[i] = points[i].toPointF();
     drawFilledTriangles(pointsF, mode);
@@ -382,7 +548,7 @@ void Painter::drawFilledTriangles(const std::vector<PointI> &points, TriangleDra
 
 void Painter::drawRect(const RectF& rect)
 {
-    static std::vector<PointF> points(5);
+    thread_local std::vector<PointF> points(5);
     points[0] = rect.topLeft();
     points[1] = rect.topRight();
     points[2] = rect.bottomRight();
@@ -405,19 +571,37 @@ void Painter::drawRects(const std::vector<RectI>& rects)
 
 void Painter::drawFilledRect(const RectF &rect)
 {
-    auto* vertexData = m_frameBuffers[m_currentFBO]->add<SolidVertexBuffer>(4, PrimitiveTypeTriangleStrip, getCurrentState());
+    DrawBounds bounds(rect.left(), rect.top(), rect.right(), rect.bottom());
+    if(m_rectInstancing) {
+        auto* instance = getRecordBuffer()->addInstances<RectInstanceBuffer>(1, getCurrentState(), bounds);
+        instance->x = rect.left();
+        instance->y = rect.top();
+        instance->w = rect.right() - rect.left();
+        instance->h = rect.bottom() - rect.top();
+        instance->u0 = instance->v0 = instance->u1 = instance->v1 = 0.0f;
+        instance->color = getRecordingContext().getState().color.rgba();
+        instance->layer = 0.0f;
+        return;
+    }
+
+    auto* vertexData = getRecordBuffer()->addQuads<SolidVertexBuffer>(1, getCurrentState(), bounds);
+    uint32_t color = getRecordingContext().getState().color.rgba();
 
     vertexData[0].x = rect.left();
     vertexData[0].y = rect.top();
+    vertexData[0].color = color;
 
     vertexData[1].x = rect.right();
     vertexData[1].y = rect.top();
+    vertexData[1].color = color;
 
     vertexData[2].x = rect.left();
     vertexData[2].y = rect.bottom();
+    vertexData[2].color = color;
 
     vertexData[3].x = rect.right();
     vertexData[3].y = rect.bottom();
+    vertexData[3].color = color;
 }
 
 void Painter::drawFilledRects(const std::vector<RectF> &rects)
@@ -428,7 +612,8 @@ void Painter::drawFilledRects(const std::vector<RectF> &rects)
 
 void Painter::drawFilledRects(const std::vector<RectI> &rects)
 {
-    static std::vector<RectF> rectsF(rects.size());
+    thread_local std::vector<RectF> rectsF;
+    rectsF.resize(rects.size());
     for(uint32_t i = 0; i < rects.size(); ++i)
         rectsF[i] = rects[i].toRectF();
     drawFilledRects(rectsF);
@@ -439,8 +624,8 @@ void Painter::drawTexturedRect(const RectF &destRect, const TexturePtr &texture,
     if(!texture)
         return;
 
-    static std::vector<RectF> destRectsF(1);
-    static std::vector<RectI> srcRects(1);
+    thread_local std::vector<RectF> destRectsF(1);
+    thread_local std::vector<RectI> srcRects(1);
     destRectsF[0] = destRect;
     srcRects[0] = srcRect;
     drawTexturedRects(destRectsF, texture, srcRects);
@@ -456,9 +641,31 @@ void Painter::drawTexturedRect(const RectF &destRect, const TexturePtr &texture)
     drawTexturedRect(destRect, texture, RectI(0, 0, texture->getSize()));
 }
 
+void Painter::drawTexturedRect(const RectF& destRect, const AtlasRegionPtr& region, const RectI& srcRect)
+{
+    if(!region)
+        return;
+
+    // the region is a rect of its page, the page's own transform matrix turns it into uvs
+    RectI pageRect = srcRect.isValid() ? srcRect.translated(region->rect.topLeft()) : region->rect;
+    drawTexturedRect(destRect, region->page, pageRect);
+}
+
+void Painter::drawTexturedRects(const std::vector<RectF>& destRects, const AtlasRegionPtr& region, const std::vector<RectI>& srcRects)
+{
+    if(!region)
+        return;
+
+    thread_local std::vector<RectI> pageRects;
+    pageRects.resize(srcRects.size());
+    for(size_t i = 0; i < srcRects.size(); ++i)
+        pageRects[i] = srcRects[i].translated(region->rect.topLeft());
+    drawTexturedRects(destRects, region->page, pageRects);
+}
+
 void Painter::drawTexturedRects(const std::vector<RectI> &destRects, const TexturePtr &texture, const std::vector<RectI> &srcRects)
 {
-    static std::vector<RectF> destRectsF;
+    thread_local std::vector<RectF> destRectsF;
     destRectsF.resize(destRects.size());
     for(int i = 0; i < destRectsF.size(); ++i)
         destRectsF[i] = destRects[i].toRectF();
@@ -471,10 +678,19 @@ void Painter::drawTexturedRects(const std::vector<RectF> &destRects, const Textu
         return;
 
     size_t size = destRects.size();
-    auto* vertexData = m_frameBuffers[m_currentFBO]->add<TexelVertexBuffer>(size * 6, PrimitiveTypeTriangleStrip, getCurrentState(), texture);
-
     const Matrix3& uvmat = texture->getTransformMatrix();
 
+    DrawBounds bounds(FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for(const RectF& destRect : destRects)
+        bounds.unite(DrawBounds(destRect.x(), destRect.y(), destRect.x() + destRect.width(), destRect.y() + destRect.height()));
+
+    if(m_rectInstancing) {
+        addTexturedRectInstances(destRects, texture, srcRects, bounds);
+        return;
+    }
+
+    auto* vertexData = getRecordBuffer()->addQuads<TexelVertexBuffer>(size, getCurrentState(), bounds, texture);
+
     for(size_t i = 0; i < size; ++i) {
         const RectF& destRect = destRects[i];
         const RectI& srcRect = srcRects[i];
@@ -489,35 +705,61 @@ void Painter::drawTexturedRects(const std::vector<RectF> &destRects, const Textu
         float sright = (srcRect.x() + srcRect.width()) * uvmat(1,1) + uvmat(3,1);
         float sbottom = (srcRect.y() + srcRect.height()) * uvmat(2,2) + uvmat(3,2);
 
-        vertexData[i*6+0].x = dleft;
-        vertexData[i*6+0].y = dtop;
-        vertexData[i*6+0].u = sleft;
-        vertexData[i*6+0].v = stop;
-
-        vertexData[i*6+1].x = dright;
-        vertexData[i*6+1].y = dtop;
-        vertexData[i*6+1].u = sright;
-        vertexData[i*6+1].v = stop;
+        vertexData[i*4+0].x = dleft;
+        vertexData[i*4+0].y = dtop;
+        vertexData[i*4+0].u = sleft;
+        vertexData[i*4+0].v = stop;
+
+        vertexData[i*4+1].x = dright;
+        vertexData[i*4+1].y = dtop;
+        vertexData[i*4+1].u = sright;
+        vertexData[i*4+1].v = stop;
+
+        vertexData[i*4+2].x = dleft;
+        vertexData[i*4+2].y = dbottom;
+        vertexData[i*4+2].u = sleft;
+        vertexData[i*4+2].v = sbottom;
+
+        vertexData[i*4+3].x = dright;
+        vertexData[i*4+3].y = dbottom;
+        vertexData[i*4+3].u = sright;
+        vertexData[i*4+3].v = sbottom;
+    }
+}
 
-        vertexData[i*6+2].x = dright;
-        vertexData[i*6+2].y = dbottom;
-        vertexData[i*6+2].u = sright;
-        vertexData[i*6+2].v = sbottom;
+void Painter::drawTexturedRectInstanced(const RectF& destRect, const TexturePtr& texture, const RectI& srcRect)
+{
+    if(!texture)
+        return;
 
-        vertexData[i*6+3].x = dleft;
-        vertexData[i*6+3].y = dtop;
-        vertexData[i*6+3].u = sleft;
-        vertexData[i*6+3].v = stop;
+    thread_local std::vector<RectF> destRectsF(1);
+    thread_local std::vector<RectI> srcRects(1);
+    destRectsF[0] = destRect;
+    srcRects[0] = srcRect;
+    addTexturedRectInstances(destRectsF, texture, srcRects, DrawBounds(destRect.left(), destRect.top(), destRect.x() + destRect.width(), destRect.y() + destRect.height()));
+}
 
-        vertexData[i*6+4].x = dright;
-        vertexData[i*6+4].y = dbottom;
-        vertexData[i*6+4].u = sright;
-        vertexData[i*6+4].v = sbottom;
+void Painter::addTexturedRectInstances(const std::vector<RectF>& destRects, const TexturePtr& texture, const std::vector<RectI>& srcRects, const DrawBounds& bounds)
+{
+    size_t size = destRects.size();
+    const Matrix3& uvmat = texture->getTransformMatrix();
 
-        vertexData[i*6+5].x = dleft;
-        vertexData[i*6+5].y = dbottom;
-        vertexData[i*6+5].u = sleft;
-        vertexData[i*6+5].v = sbottom;
+    auto* instances = getRecordBuffer()->addInstances<RectInstanceBuffer>(size, getCurrentState(), bounds, texture);
+    uint32_t color = getRecordingContext().getState().color.rgba();
+    for(size_t i = 0; i < size; ++i) {
+        const RectF& destRect = destRects[i];
+        const RectI& srcRect = srcRects[i];
+        auto& instance = instances[i];
+        instance.x = destRect.x();
+        instance.y = destRect.y();
+        instance.w = destRect.width();
+        instance.h = destRect.height();
+        instance.u0 = srcRect.x() * uvmat(1,1) + uvmat(3,1);
+        instance.v0 = srcRect.y() * uvmat(2,2) + uvmat(3,2);
+        instance.u1 = (srcRect.x() + srcRect.width()) * uvmat(1,1) + uvmat(3,1);
+        instance.v1 = (srcRect.y() + srcRect.height()) * uvmat(2,2) + uvmat(3,2);
+        instance.color = color;
+        instance.layer = 0.0f;
     }
 }
 
@@ -535,6 +777,15 @@ bool GPUCommand::acquire()
     return m_commandBuffer != nullptr;
 }
 
+SDL_GPUCommandBuffer* GPUCommand::detach()
+{
+    SDL_GPUCommandBuffer* commandBuffer = m_commandBuffer;
+    m_commandBuffer = nullptr;
+    m_width = 0;
+    m_height = 0;
+    return commandBuffer;
+}
+
 SDL_GPUTexture* GPUCommand::acquireSwapchain()
 {
     SDL_GPUTexture* texture = nullptr;
@@ -558,9 +809,15 @@ void GPUCommand::submit(bool wait)
     if(!m_commandBuffer)
         return;
     
-    SDL_GPUFence* fence = SDL_SubmitGPUCommandBufferAndAcquireFence(m_commandBuffer);
-    if(fence && wait)
-        SDL_WaitForGPUFences(g_painter->getDevice(), true, &fence, 1);
+    if(wait) {
+        SDL_GPUFence* fence = SDL_SubmitGPUCommandBufferAndAcquireFence(m_commandBuffer);
+        if(fence) {
+            SDL_WaitForGPUFences(g_painter->getDevice(), true, &fence, 1);
+            SDL_ReleaseGPUFence(g_painter->getDevice(), fence);
+        } else
+            SDL_Log("SDL_SubmitGPUCommandBufferAndAcquireFence: %s", SDL_GetError());
+    } else if(!SDL_SubmitGPUCommandBuffer(m_commandBuffer))
+        SDL_Log("SDL_SubmitGPUCommandBuffer: %s", SDL_GetError());
     m_commandBuffer = nullptr;
     m_width = 0;
     m_height = 0;
@@ -568,21 +825,25 @@ void GPUCommand::submit(bool wait)
 
 bool Painter::beginRender()
 {
-    if(m_gpuCommand.acquire()) {
-        reset();
-        m_drawnPrimitives = 0;
-        m_drawCalls = 0;
-        m_frameBuffers[0]->reset();
-        return true;
-    }
-    return false;
+    // wait until the render thread is done with the packet this frame will be recorded into
+    if(m_renderThread)
+        SDL_WaitSemaphore(m_freePackets);
+    recyclePacket(m_packets[m_packetIndex]);
+
+    // recording needs nothing from the GPU, the command buffer is acquired once the frame is recorded
+    reset();
+    m_drawnPrimitives = 0;
+    m_drawCalls = 0;
+    m_frameBuffers[0]->reset();
+    return true;
 }
 
 void Painter::endRender()
 {
     m_lastDrawnPrimitives = m_drawnPrimitives;
     m_lastDrawCalls = m_drawCalls;
-    m_stateId = 0;
+    // the state table now holds the vector of an already encoded packet
+    m_mainContext.resetStates();
 }
 
 void Painter::flushRender()
@@ -601,17 +862,45 @@ void Painter::flushRender()
     g_clock.nextFrame();*/
 }
 
+void Painter::addPendingTexture(const TexturePtr& texture, const ImagePtr& image, const RectI& region, int level)
+{
+    std::lock_guard<std::mutex> lock(m_textureUploadMutex);
+    m_packets[m_packetIndex].textureUploads.push_back({ texture, image, region, level });
+}
+
 void Painter::swapBuffers()
 {
+    // atlas pages changed this frame and streamed textures within the budget upload with it, before any pass samples them
+    m_textureAtlas.flush();
+    m_textureStreamer.update();
     draw();
+
+    FramePacket& packet = m_packets[m_packetIndex];
+    m_mainContext.swapStates(packet.states);
+    // the command buffer and the swapchain are acquired on the thread that owns the window,
+    // the render thread only encodes and submits
+    if(m_gpuCommand.acquire()) {
+        packet.swapchainTexture = m_gpuCommand.acquireSwapchain();
+        packet.swapchainWidth = m_gpuCommand.width();
+        packet.swapchainHeight = m_gpuCommand.height();
+    } else
+        SDL_Log("SDL_AcquireGPUCommandBuffer: %s", SDL_GetError());
+    packet.commandBuffer = m_gpuCommand.detach();
+
+    if(m_renderThread) {
+        m_packetQueue.push(&packet);
+        SDL_SignalSemaphore(m_readyPackets);
+    } else
+        executePacket(packet);
+
+    m_packetIndex = (m_packetIndex + 1) % FramesInFlight;
     m_frameIndex = (m_frameIndex + 1) % FramesInFlight;
-    m_gpuCommand.submit(false);
+    m_renderTargetPool.collect();
 }
 
 void Painter::pushState(bool doReset)
 {
-    m_olderStates[m_oldStateIndex].copy(m_state);
-    m_oldStateIndex++;
+    getRecordingContext().pushState();
 
     if(doReset)
         reset();
@@ -619,11 +908,9 @@ void Painter::pushState(bool doReset)
 
 void Painter::popState(bool doReset)
 {
-    m_oldStateIndex--;
+    getRecordingContext().popState(!doReset);
     if(doReset)
         reset();
-    else
-        m_state.copy(m_olderStates[m_oldStateIndex]);
 }
 
 void Painter::clear(const Color& color)
@@ -634,25 +921,248 @@ void Painter::clear(const Color& color)
     bufferManager->clear(color);
 }
 
-void Painter::draw()
+void Painter::setLoadStoreOps(SDL_GPULoadOp loadOp, SDL_GPUStoreOp storeOp)
 {
-    SDL_GPUCommandBuffer* commandBuffer = m_gpuCommand.getCommand();
-    if(!commandBuffer)
+    BufferManagerPtr bufferManager = m_frameBuffers[m_currentFBO];
+    if(!bufferManager)
         return;
+    bufferManager->setLoadStoreOps(loadOp, storeOp);
+}
 
-    BufferManagerPtr bufferManager = m_frameBuffers[m_currentFBO];
+void Painter::draw()
+{
+    BufferManagerPtr& bufferManager = m_frameBuffers[m_currentFBO];
     if(!bufferManager)
         return;
 
-    bufferManager->uploadPendingTextures(commandBuffer);
+    // reordering only looks at the commands and their recorded bounds, never at the mapped vertices
+    if(m_drawReordering)
+        bufferManager->reorder(m_mainContext.getStates());
+    bufferManager->finish();
+
+    // the recorded manager travels with the frame, recording continues into a fresh one
+    m_packets[m_packetIndex].passes.push_back({ m_currentFBO, bufferManager });
+    bufferManager = acquireBufferManager(bufferManager);
+}
+
+BufferManagerPtr Painter::acquireBufferManager(const BufferManagerPtr& previous)
+{
+    BufferManagerPtr bufferManager;
+    if(!m_bufferManagerPool.empty()) {
+        bufferManager = m_bufferManagerPool.back();
+        m_bufferManagerPool.pop_back();
+    } else
+        bufferManager = std::make_shared<BufferManager>(true);
+
+    bufferManager->inherit(*previous);
+    return bufferManager;
+}
+
+void Painter::recyclePacket(FramePacket& packet)
+{
+    for(RenderPass& pass : packet.passes) {
+        pass.bufferManager->reset();
+        pass.bufferManager->releaseTarget();
+        m_bufferManagerPool.push_back(std::move(pass.bufferManager));
+    }
+    packet.passes.clear();
+    packet.textureUploads.clear();
+    packet.commandBuffer = nullptr;
+    packet.swapchainTexture = nullptr;
+}
+
+void Painter::executePacket(FramePacket& packet)
+{
+    if(!packet.commandBuffer)
+        return;
+
+    uploadTextures(packet);
+    uploadPacket(packet);
+    for(const RenderPass& pass : packet.passes)
+        encodePass(packet, pass);
+    if(!SDL_SubmitGPUCommandBuffer(packet.commandBuffer))
+        SDL_Log("SDL_SubmitGPUCommandBuffer: %s", SDL_GetError());
+}
+
+void Painter::uploadTextures(FramePacket& packet)
+{
+    if(packet.textureUploads.empty())
+        return;
+
+    // every image is staged first, the transfer memory has to be unmapped before the copy pass reads it
+    static std::vector<StagingAllocation> allocations;
+    allocations.resize(packet.textureUploads.size());
+    for(size_t i = 0; i < packet.textureUploads.size(); ++i) {
+        const ImagePtr& image = packet.textureUploads[i].image;
+        allocations[i] = m_stagingPool.allocate((uint32_t)image->getPixelDataSize());
+        if(allocations[i].data)
+            memcpy(allocations[i].data, image->getPixelData(), image->getPixelDataSize());
+    }
+    m_stagingPool.unmap();
+
+    SDL_GPUCopyPass* copyPass = SDL_BeginGPUCopyPass(packet.commandBuffer);
+    for(size_t i = 0; i < packet.textureUploads.size(); ++i) {
+        const TextureUpload& upload = packet.textureUploads[i];
+        upload.texture->upload(copyPass, upload.image, allocations[i], upload.region, upload.level);
+    }
+    SDL_EndGPUCopyPass(copyPass);
+
+    // mip chains are rebuilt with blits, which can't run inside a copy pass
+    for(const TextureUpload& upload : packet.textureUploads) {
+        if(upload.texture->takeMipmapGeneration())
+            SDL_GenerateMipmapsForGPUTexture(packet.commandBuffer, upload.texture->get());
+    }
+    m_stagingPool.endFrame();
+}
+
+void Painter::uploadPacket(FramePacket& packet)
+{
+    // passes recorded into transfer memory upload straight from it, the rest are staged in the ring's own buffer
+    size_t size = 0;
+    size_t stagingSize = 0;
+    for(RenderPass& pass : packet.passes) {
+        const VertexArena& vertexBuffer = pass.bufferManager->getVertexBuffer();
+        pass.vertexOffset = (uint32_t)size;
+        size += RenderBuffer::align(vertexBuffer.size());
+        if(!vertexBuffer.getTransferBuffer())
+            stagingSize += RenderBuffer::align(vertexBuffer.size());
+    }
+
+    // retained blocks drawn for the first time are staged too, later frames reuse their buffers as they are
+    static std::vector<RetainedBlock*> retainedBlocks;
+    retainedBlocks.clear();
+    for(const RenderPass& pass : packet.passes) {
+        for(const RetainedBlockPtr& block : pass.bufferManager->getRetainedBlocks()) {
+            // a block drawn by several passes is staged once
+            if(block->uploaded || !block->buffer || std::find(retainedBlocks.begin(), retainedBlocks.end(), block.get()) != retainedBlocks.end())
+                continue;
+            retainedBlocks.push_back(block.get());
+            stagingSize += RenderBuffer::align(block->vertices.size());
+        }
+    }
+
+    if(size > 0 && !m_uploadBuffer.reserve(size))
+        return;
+
+    static std::vector<uint32_t> stagingOffsets;
+    stagingOffsets.assign(packet.passes.size() + retainedBlocks.size(), 0);
+    if(stagingSize > 0) {
+        unsigned char* staging = m_uploadBuffer.mapStaging(stagingSize);
+        if(!staging)
+            return;
+
+        size_t stagingOffset = 0;
+        for(size_t i = 0; i < packet.passes.size(); ++i) {
+            const VertexArena& vertexBuffer = packet.passes[i].bufferManager->getVertexBuffer();
+            if(vertexBuffer.getTransferBuffer())
+                continue;
+            memcpy(staging + stagingOffset, vertexBuffer.data(), vertexBuffer.size());
+            stagingOffsets[i] = (uint32_t)stagingOffset;
+            stagingOffset += RenderBuffer::align(vertexBuffer.size());
+        }
+        for(size_t i = 0; i < retainedBlocks.size(); ++i) {
+            RetainedBlock* block = retainedBlocks[i];
+            memcpy(staging + stagingOffset, block->vertices.data(), block->vertices.size());
+            stagingOffsets[packet.passes.size() + i] = (uint32_t)stagingOffset;
+            stagingOffset += RenderBuffer::align(block->vertices.size());
+        }
+        m_uploadBuffer.unmapStaging();
+    }
+
+    if(size == 0 && retainedBlocks.empty())
+        return;
+
+    // one copy pass for the whole frame
+    m_uploadBuffer.beginUpload(packet.commandBuffer);
+    for(size_t i = 0; i < packet.passes.size(); ++i) {
+        const RenderPass& pass = packet.passes[i];
+        const VertexArena& vertexBuffer = pass.bufferManager->getVertexBuffer();
+        if(vertexBuffer.size() == 0)
+            continue;
+        if(vertexBuffer.getTransferBuffer())
+            m_uploadBuffer.upload(vertexBuffer.getTransferBuffer(), 0, pass.vertexOffset, (uint32_t)vertexBuffer.size());
+        else
+            m_uploadBuffer.upload(nullptr, stagingOffsets[i], pass.vertexOffset, (uint32_t)vertexBuffer.size());
+    }
+    for(size_t i = 0; i < retainedBlocks.size(); ++i) {
+        RetainedBlock* block = retainedBlocks[i];
+        m_uploadBuffer.upload(nullptr, stagingOffsets[packet.passes.size() + i], 0, (uint32_t)block->vertices.size(), block->buffer);
+        // only now is the copy recorded, a frame that failed earlier stages the block again next time
+        block->uploaded = true;
+        std::vector<unsigned char>().swap(block->vertices);
+    }
+    m_uploadBuffer.endUpload();
+}
+
+bool Painter::startRenderThread()
+{
+    m_freePackets = SDL_CreateSemaphore(FramesInFlight);
+    m_readyPackets = SDL_CreateSemaphore(0);
+    if(!m_freePackets || !m_readyPackets) {
+        SDL_Log("SDL_CreateSemaphore: %s", SDL_GetError());
+        return false;
+    }
+
+    m_renderThread = SDL_CreateThread(renderThreadMain, "RenderThread", this);
+    if(!m_renderThread) {
+        SDL_Log("SDL_CreateThread: %s", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+void Painter::stopRenderThread()
+{
+    if(m_renderThread) {
+        // a null packet tells the render thread to finish
+        while(!m_packetQueue.push(nullptr))
+            SDL_WaitSemaphore(m_freePackets);
+        SDL_SignalSemaphore(m_readyPackets);
+        SDL_WaitThread(m_renderThread, nullptr);
+        m_renderThread = nullptr;
+    }
+
+    if(m_freePackets) {
+        SDL_DestroySemaphore(m_freePackets);
+        m_freePackets = nullptr;
+    }
+    if(m_readyPackets) {
+        SDL_DestroySemaphore(m_readyPackets);
+        m_readyPackets = nullptr;
+    }
+}
+
+int Painter::renderThreadMain(void* data)
+{
+    Painter* painter = static_cast<Painter*>(data);
+    while(true) {
+        SDL_WaitSemaphore(painter->m_readyPackets);
+
+        FramePacket* packet;
+        if(!painter->m_packetQueue.pop(packet) || !packet)
+            break;
+
+        painter->executePacket(*packet);
+        SDL_SignalSemaphore(painter->m_freePackets);
+    }
+    return 0;
+}
+
+void Painter::encodePass(FramePacket& packet, const RenderPass& pass)
+{
+    SDL_GPUCommandBuffer* commandBuffer = packet.commandBuffer;
+    if(!commandBuffer)
+        return;
+
+    const BufferManagerPtr& bufferManager = pass.bufferManager;
 
     SDL_GPUTexture* texture = bufferManager->getTexture();
     uint32_t width = 0, height = 0;
     if(!texture) {
-        if(m_currentFBO == 0) {
-            texture = m_gpuCommand.acquireSwapchain();
-            width = m_gpuCommand.width();
-            height = m_gpuCommand.height();
+        if(pass.fbo == 0) {
+            texture = packet.swapchainTexture;
+            width = packet.swapchainWidth;
+            height = packet.swapchainHeight;
         }
 
         if(!texture)
@@ -668,50 +1178,87 @@ void Painter::draw()
     
     SDL_zero(colorTargets[0]);
     colorTargets[0].texture = texture;
-    colorTargets[0].load_op = SDL_GPU_LOADOP_CLEAR;
-    colorTargets[0].store_op = SDL_GPU_STOREOP_STORE;
+    colorTargets[0].load_op = bufferManager->getLoadOp();
+    colorTargets[0].store_op = bufferManager->getStoreOp();
     colorTargets[0].clear_color = SDL_FColor{ clearColor.rF(), clearColor.gF(), clearColor.bF(), clearColor.aF() };
 
-    SDL_GPUBuffer* buffer = bufferManager->getBuffer(m_frameIndex);
-    if(!buffer)
+    SDL_GPURenderPass* renderPass = SDL_BeginGPURenderPass(commandBuffer, colorTargets.data(), (uint32_t)colorTargets.size(), NULL);
+
+    // a pass without commands still clears its target, one with only retained blocks has no frame vertices
+    SDL_GPUBuffer* buffer = m_uploadBuffer.getBuffer();
+    bool hasVertices = buffer && bufferManager->getVertexBuffer().size() > 0;
+    if(bufferManager->getCommands().size() == 0 || (!hasVertices && bufferManager->getRetainedBlocks().empty())) {
+        SDL_EndGPURenderPass(renderPass);
         return;
+    }
 
-    SDL_GPURenderPass* renderPass = SDL_BeginGPURenderPass(commandBuffer, colorTargets.data(), (uint32_t)colorTargets.size(), NULL);
+    // slot 1 only feeds the instanced rect programs, the others ignore it
+    static SDL_GPUBufferBinding bindings[2];
+    bindings[0].buffer = buffer;
+    bindings[0].offset = pass.vertexOffset;
+    bindings[1].buffer = m_quadCornerBuffer;
+    bindings[1].offset = 0;
 
-    bufferManager->upload(m_frameIndex);
+    if(hasVertices)
+        SDL_BindGPUVertexBuffers(renderPass, 0, bindings, 2);
+    else
+        SDL_BindGPUVertexBuffers(renderPass, 1, &bindings[1], 1);
 
-    static SDL_GPUBufferBinding binding;
-    binding.buffer = buffer;
-    binding.offset = 0;
+    static SDL_GPUBufferBinding indexBinding;
+    indexBinding.buffer = m_quadIndexBuffer;
+    indexBinding.offset = 0;
 
-    SDL_BindGPUVertexBuffers(renderPass, 0, &binding, 1);
+    SDL_BindGPUIndexBuffer(renderPass, &indexBinding, SDL_GPU_INDEXELEMENTSIZE_16BIT);
 
     Program* drawProgram = nullptr;
     int updateFlags = 0;
     int32_t lastState = -1;
+    uint16_t lastTexture = 0;
     RectI frameBufferRect(0, 0, width >> colorTargets[0].mip_level, height >> colorTargets[0].mip_level);
     SDL_GPUViewport viewport;
     SDL_Rect rect;
-    for(DrawCommand& drawCommand : *bufferManager.get()) {
-        PainterState& drawState = m_states[drawCommand.state];
-        if(lastState != drawState.id) {
+    bool retainedBound = false;
+    for(const DrawCommand& drawCommand : *bufferManager.get()) {
+        if(drawCommand.flags & DrawCommand::BindRetained) {
+            SDL_GPUBufferBinding binding;
+            binding.buffer = bufferManager->getRetainedBlock(drawCommand.offset)->buffer;
+            binding.offset = 0;
+            SDL_BindGPUVertexBuffers(renderPass, 0, &binding, 1);
+            retainedBound = true;
+            continue;
+        }
+
+        if(retainedBound && !(drawCommand.flags & DrawCommand::Retained)) {
+            if(!hasVertices)
+                continue;
+            SDL_BindGPUVertexBuffers(renderPass, 0, bindings, 1);
+            retainedBound = false;
+        }
+
+        const PainterState& drawState = packet.states[drawCommand.state];
+        if(lastState != (int32_t)drawState.id) {
             if(lastState == -1) {
-                updateFlags = MustUpdateProgramResource;
+                updateFlags |= MustUpdateProgramResource;
                 drawProgram = drawState.program;
                 if(!drawState.clipRect.isEmpty())
                     updateFlags |= MustUpdateClipRect;
                 if(!drawState.viewport.isEmpty())
                     updateFlags |= MustUpdateViewport;
             } else
-                updateFlags = drawState.flags;
+                updateFlags = drawState.diff(packet.states[lastState]);
             lastState = (int32_t)drawState.id;
         }
 
         if(!drawState.program) {
-            Program* program = g_programs.get(drawState.blendMode, drawCommand.type, drawCommand.texture != nullptr);
+            Program* program;
+            if(drawCommand.flags & DrawCommand::Instanced)
+                program = g_programs.getInstanced(drawState.blendMode, drawCommand.hasTexture());
+            else
+                program = g_programs.get(drawState.blendMode, drawCommand.getType(), drawCommand.hasTexture());
             if(drawProgram != program) {
                 drawProgram = program;
-                updateFlags = MustUpdateProgramResource;
+                // the state's own clip and viewport changes still have to be applied
+                updateFlags |= MustUpdateProgramResource;
             }
         }
 
@@ -729,8 +1276,13 @@ void Painter::draw()
             drawProgram->setSize(drawState.pointSize);
 
         if(updateFlags & MustUpdateClipRect) {
-            if(drawState.viewport.size() == drawState.resolution) {
-                rect.h = drawState.clipRect.left();
+            if(drawState.clipRect.isEmpty()) {
+                rect.x = frameBufferRect.x();
+                rect.y = frameBufferRect.y();
+                rect.w = frameBufferRect.width();
+                rect.h = frameBufferRect.height();
+            } else if(drawState.viewport.size() == drawState.resolution) {
+                rect.x = drawState.clipRect.left();
                 rect.y = drawState.resolution.h - drawState.clipRect.bottom() - 1;
                 rect.w = drawState.clipRect.width();
                 rect.h = drawState.clipRect.height();
@@ -748,10 +1300,11 @@ void Painter::draw()
             drawProgram->setResolution(drawState.resolution);
 
         if(updateFlags & MustUpdateViewport) {
-            viewport.x = (float)drawState.viewport.x();
-            viewport.y = (float)drawState.viewport.y();
-            viewport.w = (float)drawState.viewport.width();
-            viewport.h = (float)drawState.viewport.height();
+            const RectI& stateViewport = drawState.viewport.isEmpty() ? frameBufferRect : drawState.viewport;
+            viewport.x = (float)stateViewport.x();
+            viewport.y = (float)stateViewport.y();
+            viewport.w = (float)stateViewport.width();
+            viewport.h = (float)stateViewport.height();
             viewport.min_depth = 0;
             viewport.max_depth = 1;
 
@@ -763,30 +1316,28 @@ void Painter::draw()
             drawProgram->setProjectionTransformMatrix(projectionTransformMatrix);
         }
 
-        drawProgram->pushData(commandBuffer);
-
-        drawCommand.bindTexture(renderPass);
-
-        SDL_DrawGPUPrimitives(renderPass, (uint32_t)drawCommand.vertexCount, 1, (uint32_t)drawCommand.offset, 0);
-
-        if(updateFlags & MustUpdateViewport) {
-            viewport.x = 0;
-            viewport.y = 0;
-            viewport.w = (float)frameBufferRect.width();
-            viewport.h = (float)frameBufferRect.height();
-            viewport.min_depth = 0;
-            viewport.max_depth = 1;
+        // uniforms only change with the state, so consecutive commands sharing a state push nothing
+        if(updateFlags != 0)
+            drawProgram->pushData(commandBuffer);
 
-            SDL_SetGPUViewport(renderPass, &viewport);
+        if(drawCommand.texture != lastTexture || (updateFlags & MustUpdateProgram)) {
+            bufferManager->bindTexture(renderPass, drawCommand.texture);
+            lastTexture = drawCommand.texture;
         }
 
-        if(updateFlags & MustUpdateClipRect) {
-            rect.x = frameBufferRect.x();
-            rect.y = frameBufferRect.y();
-            rect.w = frameBufferRect.width();
-            rect.h = frameBufferRect.height();
-            SDL_SetGPUScissor(renderPass, &rect);
-        }
+        if(drawCommand.flags & DrawCommand::Indexed) {
+            uint32_t quads = (uint32_t)drawCommand.vertexCount / 4;
+            uint32_t firstVertex = (uint32_t)drawCommand.offset;
+            while(quads > 0) {
+                uint32_t drawQuads = std::min<uint32_t>(quads, MaxIndexedQuads);
+                SDL_DrawGPUIndexedPrimitives(renderPass, drawQuads * 6, 1, 0, (int32_t)firstVertex, 0);
+                firstVertex += drawQuads * 4;
+                quads -= drawQuads;
+            }
+        } else if(drawCommand.flags & DrawCommand::Instanced)
+            SDL_DrawGPUPrimitives(renderPass, 4, (uint32_t)drawCommand.vertexCount, 0, (uint32_t)drawCommand.offset);
+        else
+            SDL_DrawGPUPrimitives(renderPass, (uint32_t)drawCommand.vertexCount, 1, (uint32_t)drawCommand.offset, 0);
 
         updateFlags = 0;
     }
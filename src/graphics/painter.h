@@ -4,16 +4,27 @@
 #include <list>
 #include <functional>
 #include <queue>
+#include <mutex>
 
 #include "frametimer.h"
 #include "buffermanager.h"
+#include "recordingcontext.h"
+#include "renderbuffer.h"
+#include "rendertargetpool.h"
+#include "retainedgeometry.h"
+#include "texture/stagingpool.h"
+#include "texture/textureatlas.h"
+#include "texture/texturestreamer.h"
+
+#include <utils/spscqueue.h>
+#include <utils/threadpool.h>
 
 class UIWidget;
 class Window;
-class RenderBuffer;
 
 enum Graphics {
-    FramesInFlight = 2
+    FramesInFlight = 2,
+    MaxIndexedQuads = 65536 / 4
 };
 
 class GPUCommand {
@@ -26,6 +37,8 @@ public:
     void cancel();
 
     void submit(bool wait);
+    // hands the command buffer over to whoever encodes the frame, the caller submits it
+    SDL_GPUCommandBuffer* detach();
     
     SDL_GPUCommandBuffer* getCommand() const { return m_commandBuffer; }
     SDL_GPUTexture* acquireSwapchain();
@@ -38,6 +51,31 @@ private:
     uint32_t m_width, m_height;
 };
 
+struct RenderPass {
+    uint32_t fbo = 0;
+    BufferManagerPtr bufferManager;
+    uint32_t vertexOffset = 0; // where the pass's vertices start in the frame upload buffer
+};
+
+struct TextureUpload {
+    TexturePtr texture;
+    ImagePtr image;
+    RectI region; // empty for the whole texture
+    int level;
+};
+
+// everything the render thread needs to encode and submit one recorded frame, the command buffer and
+// the swapchain texture are acquired by the main thread before it is handed over
+struct FramePacket {
+    std::vector<RenderPass> passes;
+    std::vector<PainterState> states;
+    std::vector<TextureUpload> textureUploads; // uploaded before any pass, so every pass of the frame sees them
+    SDL_GPUCommandBuffer* commandBuffer = nullptr;
+    SDL_GPUTexture* swapchainTexture = nullptr;
+    uint32_t swapchainWidth = 0;
+    uint32_t swapchainHeight = 0;
+};
+
 class Painter {
 public:
     Painter() = default;
@@ -63,6 +101,8 @@ public:
 	void popState(bool doReset = false);
 
     void clear(const Color& color);
+    // load and store ops of the pass being recorded into the bound frame buffer
+    void setLoadStoreOps(SDL_GPULoadOp loadOp, SDL_GPUStoreOp storeOp);
 
     void drawPoint(const PointF& point);
     void drawPoint(const PointI& point) { drawPoint(point.toPointF()); }
@@ -101,7 +141,17 @@ public:
 
     void drawTexturedRects(const std::vector<RectI>& destRects, const TexturePtr& texture, const std::vector<RectI>& srcRects);
     void drawTexturedRects(const std::vector<RectF>& destRects, const TexturePtr& texture, const std::vector<RectI>& srcRects);
+    // source rects are relative to the region, an empty one draws the whole region
+    void drawTexturedRect(const RectF& destRect, const AtlasRegionPtr& region, const RectI& srcRect = RectI());
+    void drawTexturedRects(const std::vector<RectF>& destRects, const AtlasRegionPtr& region, const std::vector<RectI>& srcRects);
+
+    // always recorded as an instance, the one textured program every shader design builds; used to composite layers
+    void drawTexturedRectInstanced(const RectF& destRect, const TexturePtr& texture, const RectI& srcRect);
 
+    // replays a recorded block from its GPU buffer, nothing is drawn until it has been recorded
+    void drawRetained(const RetainedGeometry& geometry);
+
+    // closes the pass recorded into the bound frame buffer, it is encoded when the frame is submitted
     virtual void draw();
 
 public:
@@ -109,30 +159,95 @@ public:
     void deleteFrameBuffer(uint32_t* fboId);
     void bindFrameBuffer(uint32_t fboId);
     void setFrameBufferTexture(uint32_t fboId, const TexturePtr& texture);
-    void addPendingTexture(const TexturePtr& texture) { m_frameBuffers[m_currentFBO]->addPendingTexture(texture); }
+    RenderTargetPool& getRenderTargetPool() { return m_renderTargetPool; }
+    // uploads the texture's pixels at the start of the frame being recorded, safe from any recording thread
+    void addPendingTexture(const TexturePtr& texture, const ImagePtr& image, const RectI& region = RectI(), int level = 0);
+    TextureAtlas& getTextureAtlas() { return m_textureAtlas; }
+    TextureStreamer& getTextureStreamer() { return m_textureStreamer; }
+    // shared by parallel recording and background work such as texture streaming
+    ThreadPool& getThreadPool() { return m_threadPool; }
     SDL_GPUDevice* getDevice() const { return m_gpuDevice; }
-    GPUCommand& getGPUCommand() { return m_gpuCommand; }
 
     PainterState* getCurrentState();
 	void translate(float x, float y);
 
+    // the context bound on the calling thread, or the painter's own one
+    RecordingContext& getRecordingContext() {
+        RecordingContext* context = RecordingContext::current();
+        return context ? *context : m_mainContext;
+    }
+    const RecordingContext& getRecordingContext() const {
+        RecordingContext* context = RecordingContext::current();
+        return context ? *context : m_mainContext;
+    }
+    // appends a worker context's recording to wherever this thread records, call in a fixed order
+    void splice(const RecordingContext& context);
+    // replays a display list with its positions moved by translation
+    void splice(const DisplayList& displayList, const PointF& translation = PointF());
+
     void setColor(const Color& color);
     SizeI getResolution() const;
     void setResolution(const SizeI& resolution);
     void setViewport(const RectI& viewport);
     void setBlendMode(BlendMode blendMode);
 
+    // when enabled rects and textured rects are recorded as one RectInstanceBuffer each and drawn instanced
+    void setRectInstancing(bool enable) { m_rectInstancing = enable; }
+    bool isRectInstancing() const { return m_rectInstancing; }
+
+    // when enabled draw commands are regrouped by program, texture and state before drawing, without changing the result
+    void setDrawReordering(bool enable) { m_drawReordering = enable; }
+    bool isDrawReordering() const { return m_drawReordering; }
+
+    // must be chosen before create(); without it frames are encoded on the main thread at swapBuffers
+    void setThreadedRendering(bool enable) { m_threadedRendering = enable; }
+    bool isThreadedRendering() const { return m_threadedRendering; }
+
 protected:
+    bool startRenderThread();
+    void stopRenderThread();
+    static int renderThreadMain(void* data);
+
+    BufferManagerPtr acquireBufferManager(const BufferManagerPtr& previous);
+    void recyclePacket(FramePacket& packet);
+    void executePacket(FramePacket& packet);
+    void uploadTextures(FramePacket& packet);
+    void uploadPacket(FramePacket& packet);
+    void encodePass(FramePacket& packet, const RenderPass& pass);
+
+    void addTexturedRectInstances(const std::vector<RectF>& destRects, const TexturePtr& texture, const std::vector<RectI>& srcRects, const DrawBounds& bounds);
+
+    bool createStaticBuffers();
+    SDL_GPUBuffer* createStaticBuffer(SDL_GPUBufferUsageFlags usage, const void* data, uint32_t size);
+
     GPUCommand m_gpuCommand;
     std::unordered_map<uint32_t, BufferManagerPtr> m_frameBuffers;
 	std::string m_gpuDriver;
 	SDL_GPUDevice* m_gpuDevice = nullptr;
+    SDL_GPUBuffer* m_quadIndexBuffer = nullptr;
+    SDL_GPUBuffer* m_quadCornerBuffer = nullptr;
     uint32_t m_currentFBO = 0;
     uint32_t m_fboController = 0;
     std::queue<uint32_t> m_fboIds;
     int m_frames = 0;
     int m_frameIndex = 0;
 
+    FramePacket m_packets[FramesInFlight];
+    int m_packetIndex = 0;
+    std::vector<BufferManagerPtr> m_bufferManagerPool;
+    std::mutex m_textureUploadMutex;
+    TextureAtlas m_textureAtlas;
+    ThreadPool m_threadPool; // outlives the streamer, whose tasks it runs
+    TextureStreamer m_textureStreamer;
+    SPSCQueue<FramePacket*, FramesInFlight> m_packetQueue;
+    SDL_Semaphore* m_freePackets = nullptr;
+    SDL_Semaphore* m_readyPackets = nullptr;
+    SDL_Thread* m_renderThread = nullptr;
+    RenderBuffer m_uploadBuffer;
+    StagingPool m_stagingPool;
+    RenderTargetPool m_renderTargetPool;
+    bool m_threadedRendering = true;
+
 protected:
     void resetProjectionMatrix();
     void resetTransformMatrix();
@@ -142,14 +257,19 @@ protected:
     void setProjectionMatrix(const Matrix3& projectionMatrix);
     void setTransformMatrix(const Matrix3& transformMatrix);
 
-    PainterState m_state;
-    PainterState m_olderStates[10];
-    std::vector<PainterState> m_states;
-    int m_oldStateIndex = 0;
+    // interns foreign states into the context this thread records into
+    void remapStates(const std::vector<PainterState>& states, std::vector<size_t>& stateRemap);
+
+    BufferManager* getRecordBuffer() {
+        RecordingContext* context = RecordingContext::current();
+        return context ? context->getBufferManager() : m_frameBuffers[m_currentFBO].get();
+    }
+
+    RecordingContext m_mainContext;
+    bool m_rectInstancing = false;
+    bool m_drawReordering = false;
 
     int m_drawnPrimitives = 0;
-    int m_painterFlags = 0;
-    size_t m_stateId = 0;
     uint32_t m_drawCalls = 0;
     uint32_t m_lastDrawnPrimitives = 0;
     uint32_t m_lastDrawCalls = 0;
@@ -0,0 +1,87 @@
+#include "recordingcontext.h"
+
+static thread_local RecordingContext* t_currentContext = nullptr;
+
+RecordingContext::RecordingContext()
+{
+    m_states.resize(1);
+}
+
+void RecordingContext::begin(const PainterState& state)
+{
+    if(!m_bufferManager)
+        m_bufferManager = std::make_shared<BufferManager>();
+    m_bufferManager->reset();
+
+    resetStates();
+    m_state.copy(state);
+    m_oldStateIndex = 0;
+}
+
+void RecordingContext::bind()
+{
+    m_previousContext = t_currentContext;
+    t_currentContext = this;
+}
+
+void RecordingContext::unbind()
+{
+    if(t_currentContext == this)
+        t_currentContext = m_previousContext;
+    m_previousContext = nullptr;
+}
+
+RecordingContext* RecordingContext::current()
+{
+    return t_currentContext;
+}
+
+void RecordingContext::pushState()
+{
+    m_olderStates[m_oldStateIndex].copy(m_state);
+    m_oldStateIndex++;
+}
+
+void RecordingContext::popState(bool restore)
+{
+    m_oldStateIndex--;
+    if(restore) {
+        m_state.copy(m_olderStates[m_oldStateIndex]);
+        m_painterFlags |= MustUpdateProgramResource;
+    }
+}
+
+PainterState* RecordingContext::getCurrentState()
+{
+    if(m_painterFlags != 0) {
+        m_stateId = internState(m_state);
+        m_painterFlags = 0;
+    }
+    return &m_states[m_stateId];
+}
+
+size_t RecordingContext::internState(const PainterState& state)
+{
+    // states are interned by content, so toggling back to an earlier state reuses its id
+    size_t hash = state.hash();
+    auto range = m_stateLookup.equal_range(hash);
+    for(auto it = range.first; it != range.second; ++it) {
+        if(m_states[it->second].equals(state))
+            return it->second;
+    }
+
+    size_t id = m_states.size();
+    PainterState& newState = m_states.emplace_back(state);
+    newState.id = id;
+    m_stateLookup.emplace(hash, id);
+    return id;
+}
+
+void RecordingContext::resetStates()
+{
+    // only the default entry is kept, the next recorded draw interns the current state again
+    m_states.resize(1);
+    m_stateLookup.clear();
+    m_stateId = 0;
+    m_painterFlags |= MustUpdateProgramResource;
+}
@@ -0,0 +1,53 @@
+#ifndef RECORDINGCONTEXT_H
+#define RECORDINGCONTEXT_H
+
+#include "buffermanager.h"
+
+#include <unordered_map>
+
+// Painter state plus, for worker threads, a private vertex arena and command list.
+// Bind one on a thread and every Painter call made from that thread records into it;
+// the main thread then splices the contexts back with Painter::splice in a fixed order.
+class RecordingContext {
+public:
+    RecordingContext();
+
+    // starts a new recording from the given state, dropping anything recorded before
+    void begin(const PainterState& state);
+
+    // binding nests, unbind restores whatever the thread had bound before
+    void bind();
+    void unbind();
+    static RecordingContext* current();
+
+    PainterState& getState() { return m_state; }
+    const PainterState& getState() const { return m_state; }
+    void markDirty(int flags) { m_painterFlags |= flags; }
+
+    void pushState();
+    // restore is false when the caller resets the state itself
+    void popState(bool restore = true);
+
+    PainterState* getCurrentState();
+    size_t internState(const PainterState& state);
+    void resetStates();
+    void swapStates(std::vector<PainterState>& states) { m_states.swap(states); }
+    const std::vector<PainterState>& getStates() const { return m_states; }
+
+    BufferManager* getBufferManager() const { return m_bufferManager.get(); }
+
+private:
+    PainterState m_state;
+    PainterState m_olderStates[10];
+    int m_oldStateIndex = 0;
+    int m_painterFlags = 0;
+
+    std::vector<PainterState> m_states;
+    std::unordered_multimap<size_t, size_t> m_stateLookup; // states sharing a hash each keep an entry
+    size_t m_stateId = 0;
+
+    BufferManagerPtr m_bufferManager;
+    RecordingContext* m_previousContext = nullptr;
+};
+
+#endif
@@ -1,82 +1,124 @@
 #include "renderbuffer.h"
 #include "painter.h"
 
-RenderBuffer::RenderBuffer()
+static size_t growCapacity(size_t capacity, size_t size)
 {
-    m_buffers.resize(FramesInFlight);
+    capacity = std::max<size_t>(capacity, RenderBuffer::MinimumCapacity);
+    while(capacity < size)
+        capacity *= 2;
+    return capacity;
 }
 
 RenderBuffer::~RenderBuffer()
 {
-    for(Data& data : m_buffers) {
-        if(data.vertexBuffer)
-            SDL_ReleaseGPUBuffer(g_painter->getDevice(), data.vertexBuffer);
-        if(data.transferBuffer)
-            SDL_ReleaseGPUTransferBuffer(g_painter->getDevice(), data.transferBuffer);
+    release();
+}
+
+void RenderBuffer::release()
+{
+    if(m_vertexBuffer) {
+        SDL_ReleaseGPUBuffer(g_painter->getDevice(), m_vertexBuffer);
+        m_vertexBuffer = nullptr;
     }
+    if(m_stagingBuffer) {
+        SDL_ReleaseGPUTransferBuffer(g_painter->getDevice(), m_stagingBuffer);
+        m_stagingBuffer = nullptr;
+    }
+    m_capacity = 0;
+    m_stagingCapacity = 0;
 }
 
-SDL_GPUBuffer* RenderBuffer::acquireVertexBuffer(size_t size, int frameIndex)
+bool RenderBuffer::reserve(size_t size)
 {
-    Data& data = m_buffers[frameIndex];
-    if(data.vertexBuffer == nullptr || data.vertexSize < size) {
-        size_t bufferSize = size + 5000;
-        if(data.vertexBuffer)
-            SDL_ReleaseGPUBuffer(g_painter->getDevice(), data.vertexBuffer);
-
-        SDL_GPUBufferCreateInfo bufferInfo;
-        bufferInfo.usage = SDL_GPU_BUFFERUSAGE_VERTEX;
-        bufferInfo.size = (uint32_t)(bufferSize);
-        bufferInfo.props = 0;
-
-        data.vertexBuffer = SDL_CreateGPUBuffer(g_painter->getDevice(), &bufferInfo);
-        if(data.vertexBuffer)
-            data.vertexSize = bufferSize;
-        else
-            SDL_Log("SDL_CreateGPUBuffer: %s", SDL_GetError());
+    if(m_vertexBuffer && size <= m_capacity)
+        return true;
+
+    size_t capacity = growCapacity(m_capacity, size);
+    if(m_vertexBuffer)
+        SDL_ReleaseGPUBuffer(g_painter->getDevice(), m_vertexBuffer);
+
+    SDL_GPUBufferCreateInfo bufferInfo;
+    SDL_zero(bufferInfo);
+    bufferInfo.usage = SDL_GPU_BUFFERUSAGE_VERTEX;
+    bufferInfo.size = (uint32_t)capacity;
+
+    m_vertexBuffer = SDL_CreateGPUBuffer(g_painter->getDevice(), &bufferInfo);
+    if(!m_vertexBuffer) {
+        SDL_Log("SDL_CreateGPUBuffer: %s", SDL_GetError());
+        m_capacity = 0;
+        return false;
     }
-    return data.vertexBuffer;
+
+    m_capacity = capacity;
+    return true;
 }
 
-void RenderBuffer::upload(const void* vertexData, size_t size, int frameIndex)
+unsigned char* RenderBuffer::mapStaging(size_t size)
 {
-    // Currently based on what we need, this code contains overhead in DX12
-    // making it completely unnecessary to use CopyBufferRegion to transfer data from the CPU to the GPU
-    // only Map and UnMap working directly in the buffer created initially would be necessary, but what can we do?
-    Data& data = m_buffers[frameIndex];
-    size_t neededSize = size;
-    if(!data.transferBuffer || data.transferSize < size) {
-        if(data.transferBuffer)
-            SDL_ReleaseGPUTransferBuffer(g_painter->getDevice(), data.transferBuffer);
+    if(!m_stagingBuffer || m_stagingCapacity < size) {
+        size_t capacity = growCapacity(m_stagingCapacity, size);
+        if(m_stagingBuffer)
+            SDL_ReleaseGPUTransferBuffer(g_painter->getDevice(), m_stagingBuffer);
 
         SDL_GPUTransferBufferCreateInfo tbInfo;
+        SDL_zero(tbInfo);
         tbInfo.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
-        tbInfo.props = 0;
-        tbInfo.size = (uint32_t)(neededSize + 5000);
+        tbInfo.size = (uint32_t)capacity;
 
-        data.transferBuffer = SDL_CreateGPUTransferBuffer(g_painter->getDevice(), &tbInfo);
-        if(!data.transferBuffer) {
+        m_stagingBuffer = SDL_CreateGPUTransferBuffer(g_painter->getDevice(), &tbInfo);
+        if(!m_stagingBuffer) {
             SDL_Log("Error transfering buffer: %s", SDL_GetError());
-            return;
+            m_stagingCapacity = 0;
+            return nullptr;
         }
-        data.transferSize = neededSize + 5000;
+        m_stagingCapacity = capacity;
     }
 
-    void* map = SDL_MapGPUTransferBuffer(g_painter->getDevice(), data.transferBuffer, false);
-    memcpy(map, vertexData, neededSize);
-    SDL_UnmapGPUTransferBuffer(g_painter->getDevice(), data.transferBuffer);
+    void* map = SDL_MapGPUTransferBuffer(g_painter->getDevice(), m_stagingBuffer, true);
+    if(!map)
+        SDL_Log("SDL_MapGPUTransferBuffer: %s", SDL_GetError());
+    return static_cast<unsigned char*>(map);
+}
+
+void RenderBuffer::unmapStaging()
+{
+    SDL_UnmapGPUTransferBuffer(g_painter->getDevice(), m_stagingBuffer);
+}
+
+void RenderBuffer::beginUpload(SDL_GPUCommandBuffer* commandBuffer)
+{
+    m_copyPass = SDL_BeginGPUCopyPass(commandBuffer);
+    m_cycle = true;
+}
 
-    SDL_GPUCopyPass *cpass = SDL_BeginGPUCopyPass(g_painter->getGPUCommand().getCommand());
+void RenderBuffer::upload(SDL_GPUTransferBuffer* source, uint32_t sourceOffset, uint32_t offset, uint32_t size, SDL_GPUBuffer* destination)
+{
+    if(!m_copyPass)
+        return;
 
     SDL_GPUTransferBufferLocation loc;
-    loc.transfer_buffer = data.transferBuffer;
-    loc.offset = 0;
+    loc.transfer_buffer = source ? source : m_stagingBuffer;
+    loc.offset = sourceOffset;
 
     SDL_GPUBufferRegion dest;
-    dest.buffer = data.vertexBuffer;
-    dest.size = (uint32_t)neededSize;
-    dest.offset = 0;
+    dest.buffer = destination ? destination : m_vertexBuffer;
+    dest.offset = offset;
+    dest.size = size;
 
-    SDL_UploadToGPUBuffer(cpass, &loc, &dest, false);
-    SDL_EndGPUCopyPass(cpass);
+    if(destination) {
+        SDL_UploadToGPUBuffer(m_copyPass, &loc, &dest, false);
+        return;
+    }
+
+    // only the first copy may cycle, later ones fill other regions of the same memory
+    SDL_UploadToGPUBuffer(m_copyPass, &loc, &dest, m_cycle);
+    m_cycle = false;
+}
+
+void RenderBuffer::endUpload()
+{
+    if(m_copyPass) {
+        SDL_EndGPUCopyPass(m_copyPass);
+        m_copyPass = nullptr;
+    }
 }
@@ -4,26 +4,47 @@
 #include <utils/include.h>
 #include <graphics/shaders/program.h>
 
+// Frame-level vertex buffer shared by every pass. Each pass's vertices are copied to their own
+// offset in a single copy pass per frame, either straight from the transfer memory they were
+// recorded into or from this buffer's staging memory. The first upload of a frame cycles, so SDL
+// hands out fresh memory while the GPU still reads the previous frames instead of stalling.
 class RenderBuffer
 {
-    struct Data {
-        Data() { }
-
-        SDL_GPUBuffer* vertexBuffer = nullptr;
-        SDL_GPUTransferBuffer* transferBuffer = nullptr;
-        size_t vertexSize = 0;
-        size_t transferSize = 0;
-    };
 public:
-    RenderBuffer();
+    enum {
+        Alignment = 16,
+        MinimumCapacity = 256 * 1024
+    };
 
+    RenderBuffer() = default;
     ~RenderBuffer();
 
-    SDL_GPUBuffer* acquireVertexBuffer(size_t size, int frameIndex);
-    void upload(const void* vertexData, size_t size, int frameIndex);
+    // makes room for size bytes of vertices this frame, growing geometrically
+    bool reserve(size_t size);
+
+    // staging memory for vertices that weren't recorded into transfer memory
+    unsigned char* mapStaging(size_t size);
+    void unmapStaging();
+
+    // copies must happen outside of any render pass; a null source means the staging buffer,
+    // a null destination the frame vertex buffer
+    void beginUpload(SDL_GPUCommandBuffer* commandBuffer);
+    void upload(SDL_GPUTransferBuffer* source, uint32_t sourceOffset, uint32_t offset, uint32_t size, SDL_GPUBuffer* destination = nullptr);
+    void endUpload();
+
+    SDL_GPUBuffer* getBuffer() const { return m_vertexBuffer; }
+
+    void release();
+
+    static size_t align(size_t size) { return (size + Alignment - 1) & ~(size_t)(Alignment - 1); }
 
 private:
-    std::vector<Data> m_buffers;
+    SDL_GPUBuffer* m_vertexBuffer = nullptr;
+    SDL_GPUTransferBuffer* m_stagingBuffer = nullptr;
+    SDL_GPUCopyPass* m_copyPass = nullptr;
+    size_t m_capacity = 0;
+    size_t m_stagingCapacity = 0;
+    bool m_cycle = false;
 };
 
 #endif
@@ -0,0 +1,247 @@
+#include "rendergraph.h"
+#include "framebuffer.h"
+#include "painter.h"
+
+#include <graphics/texture/texture.h>
+
+#include <algorithm>
+
+RenderGraph::ResourceId RenderGraph::createTarget(const SizeI& size, SDL_GPUTextureFormat format)
+{
+    m_resources.push_back({ nullptr, size, format, false, -1, -1 });
+    return (ResourceId)(m_resources.size() - 1);
+}
+
+RenderGraph::ResourceId RenderGraph::importTarget(const FrameBufferPtr& frameBuffer)
+{
+    m_resources.push_back({ frameBuffer, frameBuffer ? frameBuffer->getSize() : SizeI(), frameBuffer ? frameBuffer->getFormat() : SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM, true, -1, -1 });
+    return (ResourceId)(m_resources.size() - 1);
+}
+
+void RenderGraph::addPass(ResourceId target, const std::vector<ResourceId>& inputs, const std::function<void()>& record, int flags, const Color& clearColor)
+{
+    m_passes.push_back({ target, inputs, record, flags, clearColor, SDL_GPU_LOADOP_CLEAR, SDL_GPU_STOREOP_STORE });
+}
+
+void RenderGraph::execute()
+{
+    if(m_passes.empty()) {
+        clear();
+        return;
+    }
+
+    sortPasses();
+    cullPasses();
+    assignOps();
+    aliasTargets();
+
+    for(size_t index : m_order) {
+        Pass& pass = m_passes[index];
+        Resource& target = m_resources[pass.target];
+        if(!target.frameBuffer)
+            continue;
+        if(!target.imported)
+            target.frameBuffer->resize(target.size);
+        // binding a frame buffer without a target would record into the screen
+        if(!target.frameBuffer->getTexture())
+            continue;
+
+        target.frameBuffer->bind();
+        g_painter->clear(pass.clearColor);
+        g_painter->setLoadStoreOps(pass.loadOp, pass.storeOp);
+        pass.record();
+        target.frameBuffer->release();
+    }
+
+    clear();
+}
+
+void RenderGraph::clear()
+{
+    m_resources.clear();
+    m_passes.clear();
+    m_order.clear();
+}
+
+void RenderGraph::sortPasses()
+{
+    // a reader waits for every writer of its inputs, writers of one target keep their declared order
+    size_t passCount = m_passes.size();
+    std::vector<std::vector<size_t>> edges(passCount);
+    std::vector<int> pending(passCount, 0);
+    std::vector<int> lastWriter(m_resources.size(), -1);
+    for(size_t i = 0; i < passCount; ++i) {
+        ResourceId target = m_passes[i].target;
+        if(lastWriter[target] >= 0) {
+            edges[lastWriter[target]].push_back(i);
+            pending[i]++;
+        }
+        lastWriter[target] = (int)i;
+    }
+    for(size_t i = 0; i < passCount; ++i) {
+        for(ResourceId input : m_passes[i].inputs) {
+            for(size_t writer = 0; writer < passCount; ++writer) {
+                if(writer == i || m_passes[writer].target != input)
+                    continue;
+                edges[writer].push_back(i);
+                pending[i]++;
+            }
+        }
+    }
+
+    // among the ready passes the earliest declared goes first, so independent passes keep their order
+    m_order.clear();
+    std::vector<bool> done(passCount, false);
+    while(m_order.size() < passCount) {
+        size_t next = passCount;
+        for(size_t i = 0; i < passCount; ++i) {
+            if(!done[i] && pending[i] == 0) {
+                next = i;
+                break;
+            }
+        }
+
+        if(next == passCount) {
+            SDL_Log("RenderGraph: passes depend on each other, running them in declared order.");
+            m_order.resize(passCount);
+            for(size_t i = 0; i < passCount; ++i)
+                m_order[i] = i;
+            return;
+        }
+
+        done[next] = true;
+        m_order.push_back(next);
+        for(size_t reader : edges[next])
+            pending[reader]--;
+    }
+}
+
+void RenderGraph::cullPasses()
+{
+    // walking backwards, a pass survives only if something after it (or outside the graph) needs its target
+    std::vector<bool> needed(m_resources.size(), false);
+    for(size_t i = 0; i < m_resources.size(); ++i)
+        needed[i] = m_resources[i].imported;
+
+    std::vector<size_t> order;
+    order.reserve(m_order.size());
+    for(auto it = m_order.rbegin(); it != m_order.rend(); ++it) {
+        const Pass& pass = m_passes[*it];
+        if(!needed[pass.target])
+            continue;
+        for(ResourceId input : pass.inputs)
+            needed[input] = true;
+        order.push_back(*it);
+    }
+
+    std::reverse(order.begin(), order.end());
+    m_order.swap(order);
+}
+
+void RenderGraph::assignOps()
+{
+    // the first write of a frame clears, or skips the load entirely when every pixel gets drawn
+    std::vector<bool> written(m_resources.size(), false);
+    for(size_t index : m_order) {
+        Pass& pass = m_passes[index];
+        if(written[pass.target])
+            pass.loadOp = SDL_GPU_LOADOP_LOAD;
+        else
+            pass.loadOp = (pass.flags & FullyOverwrites) ? SDL_GPU_LOADOP_DONT_CARE : SDL_GPU_LOADOP_CLEAR;
+        written[pass.target] = true;
+
+        for(ResourceId input : pass.inputs) {
+            if(!written[input] && !m_resources[input].imported)
+                SDL_Log("RenderGraph: a pass reads transient target %u before anything wrote it.", input);
+        }
+    }
+
+    // contents nobody reads afterwards don't have to leave the tile memory
+    std::vector<bool> usedLater(m_resources.size(), false);
+    for(auto it = m_order.rbegin(); it != m_order.rend(); ++it) {
+        Pass& pass = m_passes[*it];
+        pass.storeOp = (m_resources[pass.target].imported || usedLater[pass.target]) ? SDL_GPU_STOREOP_STORE : SDL_GPU_STOREOP_DONT_CARE;
+        usedLater[pass.target] = true;
+        for(ResourceId input : pass.inputs)
+            usedLater[input] = true;
+    }
+}
+
+void RenderGraph::aliasTargets()
+{
+    for(Resource& resource : m_resources) {
+        resource.firstUse = -1;
+        resource.lastUse = -1;
+    }
+
+    for(size_t position = 0; position < m_order.size(); ++position) {
+        const Pass& pass = m_passes[m_order[position]];
+        auto use = [&](ResourceId id) {
+            Resource& resource = m_resources[id];
+            if(resource.firstUse < 0)
+                resource.firstUse = (int)position;
+            resource.lastUse = (int)position;
+        };
+        use(pass.target);
+        for(ResourceId input : pass.inputs)
+            use(input);
+    }
+
+    std::vector<ResourceId> transients;
+    for(ResourceId id = 0; id < (ResourceId)m_resources.size(); ++id) {
+        if(!m_resources[id].imported && m_resources[id].firstUse >= 0)
+            transients.push_back(id);
+    }
+    std::sort(transients.begin(), transients.end(), [this](ResourceId a, ResourceId b) {
+        return m_resources[a].firstUse < m_resources[b].firstUse;
+    });
+
+    // a transient takes over the target of one whose last use is already behind it
+    struct Slot {
+        FrameBufferPtr frameBuffer;
+        SizeI bucketSize;
+        SDL_GPUTextureFormat format;
+        int busyUntil;
+    };
+    std::vector<Slot> slots;
+    std::vector<FrameBufferPtr> spare;
+    spare.swap(m_transientTargets);
+
+    for(ResourceId id : transients) {
+        Resource& resource = m_resources[id];
+        SizeI bucketSize = RenderTargetPool::roundSize(resource.size);
+
+        Slot* slot = nullptr;
+        for(Slot& candidate : slots) {
+            if(candidate.busyUntil < resource.firstUse && candidate.bucketSize == bucketSize && candidate.format == resource.format) {
+                slot = &candidate;
+                break;
+            }
+        }
+
+        if(!slot) {
+            FrameBufferPtr frameBuffer;
+            for(auto it = spare.begin(); it != spare.end(); ++it) {
+                const TexturePtr& texture = (*it)->getTexture();
+                if(texture && texture->getSize() == bucketSize && (*it)->getFormat() == resource.format) {
+                    frameBuffer = *it;
+                    spare.erase(it);
+                    break;
+                }
+            }
+            if(!frameBuffer) {
+                frameBuffer = FrameBufferPtr(new FrameBuffer());
+                frameBuffer->setFormat(resource.format);
+            }
+            slots.push_back({ frameBuffer, bucketSize, resource.format, -1 });
+            slot = &slots.back();
+        }
+
+        slot->busyUntil = resource.lastUse;
+        resource.frameBuffer = slot->frameBuffer;
+    }
+
+    // targets this frame didn't need go back to the pool through their frame buffers
+    for(const Slot& slot : slots)
+        m_transientTargets.push_back(slot.frameBuffer);
+}
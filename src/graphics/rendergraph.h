@@ -0,0 +1,71 @@
+#ifndef RENDERGRAPH_H
+#define RENDERGRAPH_H
+
+#include <utils/include.h>
+#include <utils/color.h>
+#include <utils/size.h>
+
+#include <functional>
+
+// Offscreen passes declared up front with the targets they read and write. execute() orders them
+// by their dependencies, drops passes whose output nobody reads, picks load and store ops and lets
+// transient targets with disjoint lifetimes share one texture. Built again every frame:
+//     RenderGraph::ResourceId blur = graph.createTarget(size);
+//     graph.addPass(blur, { scene }, [&]() { ...draw scene... }, RenderGraph::FullyOverwrites);
+//     graph.addPass(graph.importTarget(panel), { blur }, [&]() { graph.getFrameBuffer(blur)->draw(); });
+//     graph.execute();
+class RenderGraph {
+public:
+    using ResourceId = uint32_t;
+
+    enum PassFlags {
+        FullyOverwrites = 1 << 0 // every pixel is drawn, the previous contents are neither loaded nor cleared
+    };
+
+    // a target that only lives inside this graph, its texture may be shared with other transient targets
+    ResourceId createTarget(const SizeI& size, SDL_GPUTextureFormat format = SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM);
+    // a frame buffer that outlives the graph, passes writing it are never dropped
+    ResourceId importTarget(const FrameBufferPtr& frameBuffer);
+
+    void addPass(ResourceId target, const std::vector<ResourceId>& inputs, const std::function<void()>& record,
+                 int flags = 0, const Color& clearColor = Color(0.0f, 0.0f, 0.0f, 0.0f));
+
+    // only valid while the graph executes, for passes to draw their inputs
+    const FrameBufferPtr& getFrameBuffer(ResourceId id) const { return m_resources[id].frameBuffer; }
+
+    // records the passes on the calling (main) thread and clears the graph
+    void execute();
+    void clear();
+
+private:
+    struct Resource {
+        FrameBufferPtr frameBuffer;
+        SizeI size;
+        SDL_GPUTextureFormat format;
+        bool imported;
+        int firstUse;
+        int lastUse;
+    };
+
+    struct Pass {
+        ResourceId target;
+        std::vector<ResourceId> inputs;
+        std::function<void()> record;
+        int flags;
+        Color clearColor;
+        SDL_GPULoadOp loadOp;
+        SDL_GPUStoreOp storeOp;
+    };
+
+    void sortPasses();
+    void cullPasses();
+    void assignOps();
+    void aliasTargets();
+
+    std::vector<Resource> m_resources;
+    std::vector<Pass> m_passes;
+    std::vector<size_t> m_order; // indices into m_passes, in execution order once compiled
+    std::vector<FrameBufferPtr> m_transientTargets; // kept between frames so aliasing doesn't churn the pool
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include "rendertargetpool.h"
+
+#include <graphics/texture/texture.h>
+
+TexturePtr RenderTargetPool::acquire(const SizeI& size, SDL_GPUTextureFormat format, bool smooth)
+{
+    if(!size.isValid())
+        return nullptr;
+
+    SizeI bucketSize = roundSize(size);
+    for(Entry& entry : m_entries) {
+        if(entry.texture.use_count() != 1 || entry.format != format || entry.smooth != smooth || entry.texture->getSize() != bucketSize)
+            continue;
+        entry.lastUsedFrame = m_frame;
+        return entry.texture;
+    }
+
+    TexturePtr texture = TexturePtr(new Texture);
+    texture->setSize(bucketSize);
+    texture->setFormat(format);
+    texture->setSmooth(smooth);
+    texture->generate();
+    if(!texture->get())
+        return nullptr;
+
+    m_entries.push_back({ texture, format, smooth, m_frame });
+    return texture;
+}
+
+void RenderTargetPool::collect()
+{
+    ++m_frame;
+    for(size_t i = 0; i < m_entries.size();) {
+        Entry& entry = m_entries[i];
+        if(entry.texture.use_count() > 1)
+            entry.lastUsedFrame = m_frame;
+        else if(m_frame - entry.lastUsedFrame > MaxIdleFrames) {
+            entry = std::move(m_entries.back());
+            m_entries.pop_back();
+            continue;
+        }
+        ++i;
+    }
+}
+
+void RenderTargetPool::clear()
+{
+    m_entries.clear();
+}
+
+SizeI RenderTargetPool::roundSize(const SizeI& size)
+{
+    // a drag resize keeps landing in the same bucket instead of allocating on every event
+    return SizeI((size.w + SizeGranularity - 1) / SizeGranularity * SizeGranularity,
+                 (size.h + SizeGranularity - 1) / SizeGranularity * SizeGranularity);
+}
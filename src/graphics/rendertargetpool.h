@@ -0,0 +1,36 @@
+#ifndef RENDERTARGETPOOL_H
+#define RENDERTARGETPOOL_H
+
+#include <utils/include.h>
+#include <utils/size.h>
+
+// Color targets bucketed by rounded size and format. A target is free again once the pool holds
+// its last reference, which also covers frames still in flight; idle targets are evicted by age.
+class RenderTargetPool {
+public:
+    // the returned texture may be larger than size, callers draw from its top left corner
+    TexturePtr acquire(const SizeI& size, SDL_GPUTextureFormat format = SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM, bool smooth = false);
+    // once per frame, drops targets nobody used for a while
+    void collect();
+    void clear();
+
+    static SizeI roundSize(const SizeI& size);
+
+private:
+    enum {
+        SizeGranularity = 64,
+        MaxIdleFrames = 120
+    };
+
+    struct Entry {
+        TexturePtr texture;
+        SDL_GPUTextureFormat format;
+        bool smooth;
+        uint64_t lastUsedFrame;
+    };
+
+    std::vector<Entry> m_entries;
+    uint64_t m_frame = 0;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#include "retainedgeometry.h"
+#include "painter.h"
+
+RetainedBlock::~RetainedBlock()
+{
+    if(buffer && g_painter && g_painter->getDevice())
+        SDL_ReleaseGPUBuffer(g_painter->getDevice(), buffer);
+}
+
+// only the compact block is kept by the geometry
+static thread_local RecordingContext t_retainedContext;
+
+void RetainedGeometry::begin()
+{
+    if(m_recording)
+        return;
+
+    t_retainedContext.begin(g_painter->getRecordingContext().getState());
+    t_retainedContext.bind();
+    m_recording = true;
+}
+
+void RetainedGeometry::end()
+{
+    if(!m_recording)
+        return;
+
+    t_retainedContext.unbind();
+    m_recording = false;
+
+    RetainedBlockPtr block = std::make_shared<RetainedBlock>();
+    block->capture(t_retainedContext);
+
+    if(!block->vertices.empty()) {
+        SDL_GPUBufferCreateInfo bufferInfo;
+        SDL_zero(bufferInfo);
+        bufferInfo.usage = SDL_GPU_BUFFERUSAGE_VERTEX;
+        bufferInfo.size = (uint32_t)block->vertices.size();
+
+        block->buffer = SDL_CreateGPUBuffer(g_painter->getDevice(), &bufferInfo);
+        if(!block->buffer) {
+            SDL_Log("SDL_CreateGPUBuffer: %s", SDL_GetError());
+            return;
+        }
+    }
+
+    m_block = block;
+}
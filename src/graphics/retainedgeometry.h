@@ -0,0 +1,37 @@
+#ifndef RETAINEDGEOMETRY_H
+#define RETAINEDGEOMETRY_H
+
+#include "recordingcontext.h"
+#include "displaylist.h"
+
+// What a RetainedGeometry recorded, immutable once built. The vertices are copied to their own
+// GPU buffer by the first frame that draws the block and stay there until the block is dropped;
+// the render thread releases the CPU copy once uploaded.
+struct RetainedBlock : DisplayList {
+    ~RetainedBlock();
+
+    SDL_GPUBuffer* buffer = nullptr;
+    bool uploaded = false; // only touched by the thread that encodes frames
+};
+
+// Records painter calls once and replays them every frame with no vertex work:
+//     if(!geometry.isValid()) { geometry.begin(); ...draw...; geometry.end(); }
+//     g_painter->drawRetained(geometry);
+// Recording goes through one scratch context per thread, so a thread records one geometry at a time.
+class RetainedGeometry {
+public:
+    void begin();
+    void end();
+
+    bool isValid() const { return m_block != nullptr; }
+    // the next frame records again; frames already in flight keep drawing the old block
+    void invalidate() { m_block = nullptr; }
+
+    const RetainedBlockPtr& getBlock() const { return m_block; }
+
+private:
+    RetainedBlockPtr m_block;
+    bool m_recording = false;
+};
+
+#endif
@@ -7,6 +7,20 @@
 Programs g_programs;
 
 bool Program::createPipeline(const std::unique_ptr<Shaders> &vertexShader, const std::unique_ptr<Shaders> &fragmentShader, BlendMode blendMode, PrimitiveType primitiveType, uint32_t pitch)
+{
+    std::vector<SDL_GPUVertexBufferDescription> vertexBuffers(1);
+    SDL_zero(vertexBuffers[0]);
+
+    vertexBuffers[0].slot = 0;
+    vertexBuffers[0].input_rate = SDL_GPU_VERTEXINPUTRATE_VERTEX;
+    vertexBuffers[0].instance_step_rate = 0;
+    vertexBuffers[0].pitch = pitch;
+
+    return createPipeline(vertexShader, fragmentShader, blendMode, primitiveType, vertexBuffers, vertexShader->getVertexAttributes());
+}
+
+bool Program::createPipeline(const std::unique_ptr<Shaders> &vertexShader, const std::unique_ptr<Shaders> &fragmentShader, BlendMode blendMode, PrimitiveType primitiveType,
+    const std::vector<SDL_GPUVertexBufferDescription>& vertexBuffers, const std::vector<SDL_GPUVertexAttribute>& vertexAttributes)
 {
     SDL_GPUDevice* gpuDevice = g_painter->getDevice();
     if(!vertexShader->bind(gpuDevice))
@@ -88,18 +102,8 @@ bool Program::createPipeline(const std::unique_ptr<Shaders> &vertexShader, const
     if(primitiveType == SDL_GPU_PRIMITIVETYPE_LINELIST || primitiveType == SDL_GPU_PRIMITIVETYPE_LINESTRIP)
         pipelineInfo.rasterizer_state.fill_mode = SDL_GPU_FILLMODE_LINE;
 
-    SDL_GPUVertexBufferDescription vertexBufferDescription;
-    SDL_zero(vertexBufferDescription);
-
-    vertexBufferDescription.slot = 0;
-    vertexBufferDescription.input_rate = SDL_GPU_VERTEXINPUTRATE_VERTEX;
-    vertexBufferDescription.instance_step_rate = 0;
-    vertexBufferDescription.pitch = pitch;
-
-    const std::vector<SDL_GPUVertexAttribute>& vertexAttributes = vertexShader->getVertexAttributes();
-
-    pipelineInfo.vertex_input_state.num_vertex_buffers = 1;
-    pipelineInfo.vertex_input_state.vertex_buffer_descriptions = &vertexBufferDescription;
+    pipelineInfo.vertex_input_state.num_vertex_buffers = (uint32_t)vertexBuffers.size();
+    pipelineInfo.vertex_input_state.vertex_buffer_descriptions = vertexBuffers.data();
     pipelineInfo.vertex_input_state.num_vertex_attributes = (uint32_t)vertexAttributes.size();
     pipelineInfo.vertex_input_state.vertex_attributes = vertexAttributes.data();
 
@@ -372,10 +376,12 @@ cbuffer UBO : register(b0, space1)
 struct VertexShaderInput
 {
     float2 Position : TEXCOORD0;
+    float4 Color : TEXCOORD1;
 };
 
 struct VertexShaderOutput
 {
+    float4 color : TEXCOORD0;
     float4 position : SV_Position;
 };
 
@@ -383,28 +389,153 @@ VertexShaderOutput VSMain(VertexShaderInput input)
 {
     VertexShaderOutput vertexShaderOutput;
     vertexShaderOutput.position = mul(u_ProjectionTransformMatrix, float4(input.Position.xy, 1.0, 1.0));
+    vertexShaderOutput.color = input.Color;
     return vertexShaderOutput;
 }
 )";
 
 std::string solidColorFragmentShader = R"(
-cbuffer UBO : register(b0, space3)
+struct PixelShaderInput
 {
-    float4 u_Color;
+    float4 color : TEXCOORD0;
 };
 
-struct PixelShaderInput
+float4 PSMain(PixelShaderInput input) : SV_Target0
 {
+    return input.color;
+}
+)";
+
+// slot 0 carries one RectInstanceBuffer per instance, slot 1 the four static unit corners
+std::string rectInstanceVertexShader = R"(
+cbuffer UBO : register(b0, space1)
+{
+    float4x4 u_ProjectionTransformMatrix;
+};
+
+struct VertexShaderInput
+{
+    float2 Corner : TEXCOORD0;
+    float4 Rect : TEXCOORD1;
+    float4 TexRect : TEXCOORD2;
+    float4 Color : TEXCOORD3;
+    float Layer : TEXCOORD4;
+};
+
+struct VertexShaderOutput
+{
+    float4 color : TEXCOORD0;
+    float3 texCoord : TEXCOORD1;
     float4 position : SV_Position;
 };
 
+VertexShaderOutput VSMain(VertexShaderInput input)
+{
+    VertexShaderOutput vertexShaderOutput;
+    float2 position = input.Rect.xy + input.Corner * input.Rect.zw;
+    vertexShaderOutput.position = mul(u_ProjectionTransformMatrix, float4(position, 1.0, 1.0));
+    vertexShaderOutput.color = input.Color;
+    vertexShaderOutput.texCoord = float3(lerp(input.TexRect.xy, input.TexRect.zw, input.Corner), input.Layer);
+    return vertexShaderOutput;
+}
+)";
+
+std::string rectInstanceFragmentShader = R"(
+struct PixelShaderInput
+{
+    float4 color : TEXCOORD0;
+    float3 texCoord : TEXCOORD1;
+};
+
 float4 PSMain(PixelShaderInput input) : SV_Target0
 {
-    return u_Color;
+    return input.color;
 }
 )";
 
+std::string texturedRectInstanceFragmentShader = R"(
+Texture2DArray<float4> u_Tex0 : register(t0, space2);
+SamplerState u_Sampler0 : register(s0, space2);
+
+struct PixelShaderInput
+{
+    float4 color : TEXCOORD0;
+    float3 texCoord : TEXCOORD1;
+};
+
+float4 PSMain(PixelShaderInput input) : SV_Target0
+{
+    return u_Tex0.Sample(u_Sampler0, input.texCoord) * input.color;
+}
+)";
+
+#endif
+
+// the packed color can't be told apart from a float4 by reflection, so the solid layout is spelled out
+static void getSolidVertexLayout(std::vector<SDL_GPUVertexBufferDescription>& vertexBuffers, std::vector<SDL_GPUVertexAttribute>& vertexAttributes)
+{
+    vertexBuffers.resize(1);
+    SDL_zero(vertexBuffers[0]);
+    vertexBuffers[0].slot = 0;
+    vertexBuffers[0].input_rate = SDL_GPU_VERTEXINPUTRATE_VERTEX;
+    vertexBuffers[0].pitch = sizeof(SolidVertexBuffer);
+
+    vertexAttributes = {
+        { 0, 0, SDL_GPU_VERTEXELEMENTFORMAT_FLOAT2, (uint32_t)offsetof(SolidVertexBuffer, x) },
+        { 1, 0, SDL_GPU_VERTEXELEMENTFORMAT_UBYTE4_NORM, (uint32_t)offsetof(SolidVertexBuffer, color) }
+    };
+}
+
+static void getRectInstanceLayout(std::vector<SDL_GPUVertexBufferDescription>& vertexBuffers, std::vector<SDL_GPUVertexAttribute>& vertexAttributes)
+{
+    vertexBuffers.resize(2);
+    SDL_zero(vertexBuffers[0]);
+    vertexBuffers[0].slot = 0;
+    vertexBuffers[0].input_rate = SDL_GPU_VERTEXINPUTRATE_INSTANCE;
+    vertexBuffers[0].pitch = sizeof(RectInstanceBuffer);
+
+    SDL_zero(vertexBuffers[1]);
+    vertexBuffers[1].slot = 1;
+    vertexBuffers[1].input_rate = SDL_GPU_VERTEXINPUTRATE_VERTEX;
+    vertexBuffers[1].pitch = sizeof(float) * 2;
+
+    vertexAttributes = {
+        { 0, 1, SDL_GPU_VERTEXELEMENTFORMAT_FLOAT2, 0 },
+        { 1, 0, SDL_GPU_VERTEXELEMENTFORMAT_FLOAT4, (uint32_t)offsetof(RectInstanceBuffer, x) },
+        { 2, 0, SDL_GPU_VERTEXELEMENTFORMAT_FLOAT4, (uint32_t)offsetof(RectInstanceBuffer, u0) },
+        { 3, 0, SDL_GPU_VERTEXELEMENTFORMAT_UBYTE4_NORM, (uint32_t)offsetof(RectInstanceBuffer, color) },
+        { 4, 0, SDL_GPU_VERTEXELEMENTFORMAT_FLOAT, (uint32_t)offsetof(RectInstanceBuffer, layer) }
+    };
+}
+
+bool Programs::initInstanced(const std::string& gpuDriver)
+{
+#ifdef USE_LUNA_SHADERS_DESIGN
+    std::unique_ptr<Shaders> vsShader(new Shaders);
+    if(!vsShader->compile(rectInstanceVertexShader, "rectInstanceVertexShader", true, gpuDriver))
+        return false;
+
+    std::unique_ptr<Shaders> fsShaders[2] = { std::unique_ptr<Shaders>(new Shaders), std::unique_ptr<Shaders>(new Shaders) };
+    if(!fsShaders[0]->compile(rectInstanceFragmentShader, "rectInstanceFragmentShader", false, gpuDriver) ||
+        !fsShaders[1]->compile(texturedRectInstanceFragmentShader, "texturedRectInstanceFragmentShader", false, gpuDriver))
+        return false;
+
+    std::vector<SDL_GPUVertexBufferDescription> vertexBuffers;
+    std::vector<SDL_GPUVertexAttribute> vertexAttributes;
+    getRectInstanceLayout(vertexBuffers, vertexAttributes);
+
+    for(uint8_t b = 0; b < BlendMode_Last; ++b) {
+        for(uint8_t texture = 0; texture < 2; ++texture) {
+            Program* program = getInstanced((BlendMode)b, texture != 0);
+            if(!program->createPipeline(vsShader, fsShaders[texture], (BlendMode)b, PrimitiveTypeTriangleStrip, vertexBuffers, vertexAttributes)) {
+                std::cout << "Failed to create instanced rect program." << std::endl;
+                return false;
+            }
+        }
+    }
 #endif
+    return true;
+}
 
 bool Programs::init(const std::string& gpuDriver)
 {
@@ -421,12 +552,16 @@ bool Programs::init(const std::string& gpuDriver)
     if(!vsShader->compile(mainVertexShader, "mainVertexShader", true, gpuDriver) || !fsShader->compile(solidColorFragmentShader, "solidColorFragmentShader", false, gpuDriver))
         return false;
 
+    std::vector<SDL_GPUVertexBufferDescription> solidVertexBuffers;
+    std::vector<SDL_GPUVertexAttribute> solidVertexAttributes;
+    getSolidVertexLayout(solidVertexBuffers, solidVertexAttributes);
+
     for(uint8_t b = 0; b < BlendMode_Last; ++b) {
         for(uint8_t i = 0; i < LastPrimitiveType; ++i) {
             PrimitiveType primitiveType = (PrimitiveType)i;
             BlendMode blendMode = (BlendMode)b;
             Program* program = g_programs.get(blendMode, primitiveType, 0);
-            if(!program->createPipeline(vsShader, fsShader, blendMode, primitiveType, (uint32_t)sizeof(SolidVertexBuffer))) {
+            if(!program->createPipeline(vsShader, fsShader, blendMode, primitiveType, solidVertexBuffers, solidVertexAttributes)) {
                 std::cout << "Failed to create " << getPrimitiveType(primitiveType) << " program to shader." << std::endl;
                 return false;
             }
@@ -474,13 +609,22 @@ bool Programs::init(const std::string& gpuDriver)
             sizeof(TexelVertexBuffer)
         };
 
+        std::vector<SDL_GPUVertexBufferDescription> solidVertexBuffers;
+        std::vector<SDL_GPUVertexAttribute> solidVertexAttributes;
+        getSolidVertexLayout(solidVertexBuffers, solidVertexAttributes);
+
         for(uint8_t b = 0; b < BlendMode_Last; ++b) {
             for(uint8_t i = 0; i < LastPrimitiveType; ++i) {
                 PrimitiveType primitiveType = (PrimitiveType)i;
                 BlendMode blendMode = (BlendMode)b;
                 uint32_t texture = shaderFile == "texture";
                 Program* program = g_programs.get(blendMode, primitiveType, texture != 0);
-                if(!program->createPipeline(vsShader, fsShader, blendMode, primitiveType, (uint32_t)BUFFERS[texture])) {
+                bool created;
+                if(texture)
+                    created = program->createPipeline(vsShader, fsShader, blendMode, primitiveType, (uint32_t)BUFFERS[texture]);
+                else
+                    created = program->createPipeline(vsShader, fsShader, blendMode, primitiveType, solidVertexBuffers, solidVertexAttributes);
+                if(!created) {
                     std::cout << "Failed to create " << getPrimitiveType(primitiveType) << " program to shader " << shaderFile << "." << std::endl;
                     return false;
                 }
@@ -489,5 +633,5 @@ bool Programs::init(const std::string& gpuDriver)
     }
 #endif
 
-    return true;
+    return initInstanced(gpuDriver);
 }
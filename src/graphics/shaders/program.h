@@ -37,6 +37,7 @@ enum ShaderFeatures {
 
 struct SolidVertexBuffer {
 	float x, y;
+	uint32_t color; // RGBA8, read as UBYTE4_NORM
 };
 
 struct TexelVertexBuffer {
@@ -45,6 +46,14 @@ struct TexelVertexBuffer {
     float r, g, b, a;
 };
 
+// one per rect, the instanced rect program expands it to the four corners
+struct RectInstanceBuffer {
+    float x, y, w, h;
+    float u0, v0, u1, v1;
+    uint32_t color;
+    float layer;
+};
+
 class Window;
 class Program {
 	union Uniform {
@@ -88,6 +97,8 @@ public:
 	Program(SDL_GPUSampleCount sampleCount = SDL_GPU_SAMPLECOUNT_1) : m_sampleCount(sampleCount) { }
 
 	bool createPipeline(const std::unique_ptr<Shaders>& vertexShader, const std::unique_ptr<Shaders>& fragmentShader, BlendMode blendMode, PrimitiveType primitiveType, uint32_t pitch);
+	bool createPipeline(const std::unique_ptr<Shaders>& vertexShader, const std::unique_ptr<Shaders>& fragmentShader, BlendMode blendMode, PrimitiveType primitiveType,
+		const std::vector<SDL_GPUVertexBufferDescription>& vertexBuffers, const std::vector<SDL_GPUVertexAttribute>& vertexAttributes);
 	void destroy();
 
 	bool link() const { return true; }
@@ -132,13 +143,22 @@ public:
 		return &m_programs[index];
 	}
 
+	Program* getInstanced(BlendMode blendMode, bool texture) {
+		return &m_instancedPrograms[(size_t)blendMode * 2 + texture];
+	}
+
 	void clear() {
 		for(size_t i = 0; i < SDL_arraysize(m_programs); ++i)
 			m_programs[i].destroy();
+		for(size_t i = 0; i < SDL_arraysize(m_instancedPrograms); ++i)
+			m_instancedPrograms[i].destroy();
 	}
 
 private:
+	bool initInstanced(const std::string& gpuDriver);
+
 	Program m_programs[BlendMode_Last * LastPrimitiveType * 2];
+	Program m_instancedPrograms[BlendMode_Last * 2];
 };
 
 extern Programs g_programs;
@@ -0,0 +1,254 @@
+#include "blockencoder.h"
+
+#include <graphics/painter.h>
+#include <graphics/image.h>
+
+namespace {
+
+uint16_t packColor565(int r, int g, int b)
+{
+    return (uint16_t)(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+}
+
+void unpackColor565(uint16_t color, int* rgb)
+{
+    int r = (color >> 11) & 31;
+    int g = (color >> 5) & 63;
+    int b = color & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+int channel(uint32_t texel, int index)
+{
+    return (texel >> (index * 8)) & 0xff;
+}
+
+}
+
+bool BlockEncoder::isCompressed(SDL_GPUTextureFormat format)
+{
+    return getBlockSide(format) > 1;
+}
+
+int BlockEncoder::getBlockSide(SDL_GPUTextureFormat format)
+{
+    switch(format) {
+    case SDL_GPU_TEXTUREFORMAT_BC1_RGBA_UNORM:
+    case SDL_GPU_TEXTUREFORMAT_BC2_RGBA_UNORM:
+    case SDL_GPU_TEXTUREFORMAT_BC3_RGBA_UNORM:
+    case SDL_GPU_TEXTUREFORMAT_BC4_R_UNORM:
+    case SDL_GPU_TEXTUREFORMAT_BC5_RG_UNORM:
+    case SDL_GPU_TEXTUREFORMAT_BC7_RGBA_UNORM:
+    case SDL_GPU_TEXTUREFORMAT_ASTC_4x4_UNORM:
+        return 4;
+    case SDL_GPU_TEXTUREFORMAT_ASTC_8x8_UNORM:
+        return 8;
+    default:
+        return 1;
+    }
+}
+
+uint32_t BlockEncoder::getBlockBytes(SDL_GPUTextureFormat format)
+{
+    switch(format) {
+    case SDL_GPU_TEXTUREFORMAT_BC1_RGBA_UNORM:
+    case SDL_GPU_TEXTUREFORMAT_BC4_R_UNORM:
+        return 8;
+    case SDL_GPU_TEXTUREFORMAT_BC2_RGBA_UNORM:
+    case SDL_GPU_TEXTUREFORMAT_BC3_RGBA_UNORM:
+    case SDL_GPU_TEXTUREFORMAT_BC5_RG_UNORM:
+    case SDL_GPU_TEXTUREFORMAT_BC7_RGBA_UNORM:
+    case SDL_GPU_TEXTUREFORMAT_ASTC_4x4_UNORM:
+    case SDL_GPU_TEXTUREFORMAT_ASTC_8x8_UNORM:
+        return 16;
+    default:
+        return 4;
+    }
+}
+
+uint32_t BlockEncoder::getRowBytes(SDL_GPUTextureFormat format, int width)
+{
+    int side = getBlockSide(format);
+    return (uint32_t)((width + side - 1) / side) * getBlockBytes(format);
+}
+
+uint32_t BlockEncoder::getDataSize(SDL_GPUTextureFormat format, const SizeI& size)
+{
+    int side = getBlockSide(format);
+    return getRowBytes(format, size.w) * (uint32_t)((size.h + side - 1) / side);
+}
+
+bool BlockEncoder::canEncode(SDL_GPUTextureFormat format)
+{
+    return format == SDL_GPU_TEXTUREFORMAT_BC1_RGBA_UNORM || format == SDL_GPU_TEXTUREFORMAT_BC3_RGBA_UNORM ||
+        format == SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM;
+}
+
+SDL_GPUTextureFormat BlockEncoder::selectFormat(bool alpha, bool encodableOnly)
+{
+    // desktop GPUs have BC, mobile ones ASTC; SDL_gpu exposes no ETC2 format
+    const SDL_GPUTextureFormat candidates[] = {
+        SDL_GPU_TEXTUREFORMAT_BC7_RGBA_UNORM,
+        alpha ? SDL_GPU_TEXTUREFORMAT_BC3_RGBA_UNORM : SDL_GPU_TEXTUREFORMAT_BC1_RGBA_UNORM,
+        SDL_GPU_TEXTUREFORMAT_ASTC_4x4_UNORM
+    };
+
+    SDL_GPUDevice* device = g_painter->getDevice();
+    for(SDL_GPUTextureFormat format : candidates) {
+        if(encodableOnly && !canEncode(format))
+            continue;
+        if(SDL_GPUTextureSupportsFormat(device, format, SDL_GPU_TEXTURETYPE_2D_ARRAY, SDL_GPU_TEXTUREUSAGE_SAMPLER))
+            return format;
+    }
+    return SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM;
+}
+
+ImagePtr BlockEncoder::encode(const Image& image, SDL_GPUTextureFormat format)
+{
+    if(image.getFormat() != SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM || !canEncode(format)) {
+        SDL_Log("BlockEncoder: can't encode into format %d.", (int)format);
+        return nullptr;
+    }
+    if(format == SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM)
+        return ImagePtr(new Image(reinterpret_cast<const uint32_t*>(image.getPixelData()), image.getWidth(), image.getHeight()));
+
+    // padding up to whole blocks keeps every mip level and copy region block aligned
+    SizeI size((image.getSize().w + 3) & ~3, (image.getSize().h + 3) & ~3);
+    std::vector<uint8_t> blocks(getDataSize(format, size));
+    uint32_t blockBytes = getBlockBytes(format);
+    bool alphaBlock = format == SDL_GPU_TEXTUREFORMAT_BC3_RGBA_UNORM;
+
+    uint8_t* output = blocks.data();
+    uint32_t texels[16];
+    for(int blockY = 0; blockY < size.h; blockY += 4) {
+        for(int blockX = 0; blockX < size.w; blockX += 4) {
+            for(int i = 0; i < 16; ++i) {
+                uint32_t x = blockX + (i & 3);
+                uint32_t y = blockY + (i >> 2);
+                texels[i] = (x < image.getWidth() && y < image.getHeight()) ? *reinterpret_cast<const uint32_t*>(image.getPixelData(x, y)) : 0;
+            }
+
+            if(alphaBlock) {
+                encodeAlphaBlock(texels, output);
+                encodeColorBlock(texels, false, output + 8);
+            } else
+                encodeColorBlock(texels, true, output);
+            output += blockBytes;
+        }
+    }
+    return ImagePtr(new Image(std::move(blocks), size, format));
+}
+
+void BlockEncoder::encodeColorBlock(const uint32_t* texels, bool allowTransparent, uint8_t* output)
+{
+    // endpoints span the bounding box of the block's colors, inset a little so they sit on the cluster
+    int minColor[3] = { 255, 255, 255 };
+    int maxColor[3] = { 0, 0, 0 };
+    bool transparent = false;
+    for(int i = 0; i < 16; ++i) {
+        if(allowTransparent && channel(texels[i], 3) < 128) {
+            transparent = true;
+            continue;
+        }
+        for(int c = 0; c < 3; ++c) {
+            minColor[c] = std::min(minColor[c], channel(texels[i], c));
+            maxColor[c] = std::max(maxColor[c], channel(texels[i], c));
+        }
+    }
+    if(minColor[0] > maxColor[0]) {
+        for(int c = 0; c < 3; ++c)
+            minColor[c] = maxColor[c] = 0;
+    }
+    for(int c = 0; c < 3; ++c) {
+        int inset = (maxColor[c] - minColor[c]) / 16;
+        minColor[c] += inset;
+        maxColor[c] -= inset;
+    }
+
+    uint16_t color0 = packColor565(maxColor[0], maxColor[1], maxColor[2]);
+    uint16_t color1 = packColor565(minColor[0], minColor[1], minColor[2]);
+    // color0 > color1 selects four colors, otherwise three and transparent black
+    if(transparent ? color0 > color1 : color0 < color1)
+        std::swap(color0, color1);
+    bool fourColors = color0 > color1;
+
+    int palette[4][3];
+    unpackColor565(color0, palette[0]);
+    unpackColor565(color1, palette[1]);
+    for(int c = 0; c < 3; ++c) {
+        if(fourColors) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        } else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+
+    uint32_t indices = 0;
+    int paletteSize = fourColors ? 4 : 3;
+    for(int i = 0; i < 16; ++i) {
+        uint32_t index = 3;
+        if(!transparent || channel(texels[i], 3) >= 128) {
+            int bestDistance = INT32_MAX;
+            for(int p = 0; p < paletteSize; ++p) {
+                int distance = 0;
+                for(int c = 0; c < 3; ++c) {
+                    int delta = channel(texels[i], c) - palette[p][c];
+                    distance += delta * delta;
+                }
+                if(distance < bestDistance) {
+                    bestDistance = distance;
+                    index = p;
+                }
+            }
+        }
+        indices |= index << (i * 2);
+    }
+
+    output[0] = color0 & 0xff;
+    output[1] = color0 >> 8;
+    output[2] = color1 & 0xff;
+    output[3] = color1 >> 8;
+    for(int i = 0; i < 4; ++i)
+        output[4 + i] = (indices >> (i * 8)) & 0xff;
+}
+
+void BlockEncoder::encodeAlphaBlock(const uint32_t* texels, uint8_t* output)
+{
+    int minAlpha = 255;
+    int maxAlpha = 0;
+    for(int i = 0; i < 16; ++i) {
+        minAlpha = std::min(minAlpha, channel(texels[i], 3));
+        maxAlpha = std::max(maxAlpha, channel(texels[i], 3));
+    }
+
+    // alpha0 > alpha1 interpolates six values between them
+    int palette[8];
+    palette[0] = maxAlpha;
+    palette[1] = minAlpha;
+    for(int i = 1; i < 7; ++i)
+        palette[i + 1] = ((7 - i) * maxAlpha + i * minAlpha) / 7;
+
+    uint64_t indices = 0;
+    for(int i = 0; i < 16; ++i) {
+        int alpha = channel(texels[i], 3);
+        uint64_t index = 0;
+        int bestDistance = 256;
+        for(int p = 0; p < 8 && maxAlpha > minAlpha; ++p) {
+            int distance = std::abs(alpha - palette[p]);
+            if(distance < bestDistance) {
+                bestDistance = distance;
+                index = p;
+            }
+        }
+        indices |= index << (i * 3);
+    }
+
+    output[0] = (uint8_t)maxAlpha;
+    output[1] = (uint8_t)minAlpha;
+    for(int i = 0; i < 6; ++i)
+        output[2 + i] = (indices >> (i * 8)) & 0xff;
+}
@@ -0,0 +1,35 @@
+#ifndef BLOCKENCODER_H
+#define BLOCKENCODER_H
+
+#include <utils/include.h>
+#include <utils/size.h>
+
+// Block compressed texture formats. Every 4x4 (or 8x8 for ASTC 8x8) texel block is stored in 8 or
+// 16 bytes, 4 to 8 times less than RGBA8 in VRAM and in upload bandwidth. BC1 and BC3 can be
+// encoded here for the asset pipeline, BC7 and ASTC have to come cooked by an offline tool:
+//     SDL_GPUTextureFormat format = BlockEncoder::selectFormat(hasAlpha, true);
+//     texture->uploadPixels(BlockEncoder::encode(*image, format));
+class BlockEncoder {
+public:
+    static bool isCompressed(SDL_GPUTextureFormat format);
+    // texels per block side, 1 for uncompressed formats
+    static int getBlockSide(SDL_GPUTextureFormat format);
+    // bytes per block, or per texel for uncompressed formats
+    static uint32_t getBlockBytes(SDL_GPUTextureFormat format);
+    static uint32_t getRowBytes(SDL_GPUTextureFormat format, int width);
+    static uint32_t getDataSize(SDL_GPUTextureFormat format, const SizeI& size);
+
+    static bool canEncode(SDL_GPUTextureFormat format);
+    // the first format the device samples out of BC7, BC3 or BC1, ASTC 4x4 and RGBA8, in that order;
+    // encodableOnly leaves out the formats encode() can't produce
+    static SDL_GPUTextureFormat selectFormat(bool alpha, bool encodableOnly = false);
+
+    // the result is padded with transparent texels up to whole blocks, nullptr if format can't be encoded
+    static ImagePtr encode(const Image& image, SDL_GPUTextureFormat format);
+
+private:
+    static void encodeColorBlock(const uint32_t* texels, bool allowTransparent, uint8_t* output);
+    static void encodeAlphaBlock(const uint32_t* texels, uint8_t* output);
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include "stagingpool.h"
+
+#include <graphics/painter.h>
+
+StagingPool::~StagingPool()
+{
+    release();
+}
+
+StagingAllocation StagingPool::allocate(uint32_t size)
+{
+    StagingAllocation allocation;
+    if(size == 0)
+        return allocation;
+
+    // small uploads share the ring, which is mapped once per frame on its first use
+    uint32_t offset = (m_ringOffset + Alignment - 1) & ~(uint32_t)(Alignment - 1);
+    if(size <= RingSize && offset + size <= RingSize) {
+        if(!m_ring.buffer)
+            m_ring.size = RingSize;
+        if(map(m_ring)) {
+            allocation.buffer = m_ring.buffer;
+            allocation.offset = offset;
+            allocation.data = m_ring.data + offset;
+            m_ringOffset = offset + size;
+            return allocation;
+        }
+    }
+
+    int sizeClass = getSizeClass(size);
+    if(sizeClass < 0) {
+        SDL_Log("StagingPool: upload of %u bytes is too big.", size);
+        return allocation;
+    }
+
+    Buffer buffer;
+    std::vector<Buffer>& freeBuffers = m_freeBuffers[sizeClass];
+    if(!freeBuffers.empty()) {
+        buffer = freeBuffers.back();
+        freeBuffers.pop_back();
+    } else
+        buffer.size = 1u << (sizeClass + MinClassShift);
+
+    if(!map(buffer)) {
+        freeBuffers.push_back(buffer);
+        return allocation;
+    }
+
+    allocation.buffer = buffer.buffer;
+    allocation.data = buffer.data;
+    m_usedBuffers.push_back({ sizeClass, buffer });
+    return allocation;
+}
+
+bool StagingPool::map(Buffer& buffer)
+{
+    if(buffer.data)
+        return true;
+
+    SDL_GPUDevice* device = g_painter->getDevice();
+    if(!buffer.buffer) {
+        SDL_GPUTransferBufferCreateInfo transferInfo;
+        SDL_zero(transferInfo);
+        transferInfo.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
+        transferInfo.size = buffer.size;
+
+        buffer.buffer = SDL_CreateGPUTransferBuffer(device, &transferInfo);
+        if(!buffer.buffer) {
+            SDL_Log("SDL_CreateGPUTransferBuffer: %s", SDL_GetError());
+            return false;
+        }
+    }
+
+    // cycling hands out fresh memory when the GPU still reads what the last frame wrote
+    buffer.data = (uint8_t*)SDL_MapGPUTransferBuffer(device, buffer.buffer, true);
+    if(!buffer.data) {
+        SDL_Log("SDL_MapGPUTransferBuffer: %s", SDL_GetError());
+        return false;
+    }
+    buffer.lastUsedFrame = m_frame;
+    return true;
+}
+
+void StagingPool::unmap()
+{
+    SDL_GPUDevice* device = g_painter->getDevice();
+    if(m_ring.data) {
+        SDL_UnmapGPUTransferBuffer(device, m_ring.buffer);
+        m_ring.data = nullptr;
+    }
+    for(auto& used : m_usedBuffers) {
+        if(used.second.data) {
+            SDL_UnmapGPUTransferBuffer(device, used.second.buffer);
+            used.second.data = nullptr;
+        }
+    }
+}
+
+void StagingPool::endFrame()
+{
+    unmap();
+    m_ringOffset = 0;
+    for(auto& used : m_usedBuffers)
+        m_freeBuffers[used.first].push_back(used.second);
+    m_usedBuffers.clear();
+    ++m_frame;
+
+    // size classes a loading screen filled up go away once nothing uploads that much anymore
+    SDL_GPUDevice* device = g_painter->getDevice();
+    for(std::vector<Buffer>& freeBuffers : m_freeBuffers) {
+        for(size_t i = 0; i < freeBuffers.size();) {
+            if(m_frame - freeBuffers[i].lastUsedFrame > MaxIdleFrames) {
+                SDL_ReleaseGPUTransferBuffer(device, freeBuffers[i].buffer);
+                freeBuffers[i] = freeBuffers.back();
+                freeBuffers.pop_back();
+            } else
+                ++i;
+        }
+    }
+}
+
+void StagingPool::release()
+{
+    if(!g_painter || !g_painter->getDevice())
+        return;
+
+    unmap();
+    SDL_GPUDevice* device = g_painter->getDevice();
+    if(m_ring.buffer)
+        SDL_ReleaseGPUTransferBuffer(device, m_ring.buffer);
+    m_ring = Buffer();
+    m_ringOffset = 0;
+    for(auto& used : m_usedBuffers)
+        SDL_ReleaseGPUTransferBuffer(device, used.second.buffer);
+    m_usedBuffers.clear();
+    for(std::vector<Buffer>& freeBuffers : m_freeBuffers) {
+        for(Buffer& buffer : freeBuffers)
+            SDL_ReleaseGPUTransferBuffer(device, buffer.buffer);
+        freeBuffers.clear();
+    }
+}
+
+int StagingPool::getSizeClass(uint32_t size)
+{
+    int sizeClass = 0;
+    while(sizeClass < ClassCount && (1ull << (sizeClass + MinClassShift)) < size)
+        ++sizeClass;
+    return sizeClass < ClassCount ? sizeClass : -1;
+}
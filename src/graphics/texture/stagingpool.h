@@ -0,0 +1,53 @@
+#ifndef STAGINGPOOL_H
+#define STAGINGPOOL_H
+
+#include <utils/include.h>
+
+struct StagingAllocation {
+    SDL_GPUTransferBuffer* buffer = nullptr;
+    uint32_t offset = 0;
+    uint8_t* data = nullptr;
+};
+
+// Upload memory shared by all texture uploads of a frame. Small uploads are packed one after the
+// other into a ring buffer, bigger ones take a buffer of their power of two size class. Every buffer
+// is mapped with cycling once per frame, so memory the GPU still reads is never written over and
+// nothing is created or released per upload. Only used by the thread that encodes frames.
+class StagingPool {
+public:
+    ~StagingPool();
+
+    StagingAllocation allocate(uint32_t size);
+    // before the copy pass that reads the allocations
+    void unmap();
+    // after the frame's copies are recorded, its buffers may be mapped again by the next frame
+    void endFrame();
+    void release();
+
+private:
+    enum {
+        RingSize = 4 * 1024 * 1024,
+        MinClassShift = 16, // 64 KB
+        ClassCount = 16,
+        MaxIdleFrames = 300,
+        Alignment = 16
+    };
+
+    struct Buffer {
+        SDL_GPUTransferBuffer* buffer = nullptr;
+        uint32_t size = 0;
+        uint8_t* data = nullptr;
+        uint64_t lastUsedFrame = 0;
+    };
+
+    bool map(Buffer& buffer);
+    static int getSizeClass(uint32_t size);
+
+    Buffer m_ring;
+    uint32_t m_ringOffset = 0;
+    std::vector<Buffer> m_freeBuffers[ClassCount];
+    std::vector<std::pair<int, Buffer>> m_usedBuffers;
+    uint64_t m_frame = 0;
+};
+
+#endif
@@ -4,6 +4,8 @@
 #include <graphics/painter.h>
 #include <graphics/image.h>
 
+#include "blockencoder.h"
+
 Texture::~Texture()
 {
     if(m_texture)
@@ -12,20 +14,28 @@ Texture::~Texture()
         SDL_ReleaseGPUSampler(g_painter->getDevice(), m_sampler);
 }
 
-void Texture::generate()
+void Texture::generate(SDL_GPUTextureUsageFlags usage)
 {
+    if(m_texture)
+        SDL_ReleaseGPUTexture(g_painter->getDevice(), m_texture);
+
     SDL_GPUTextureCreateInfo textureInfo;
     SDL_zero(textureInfo);
     textureInfo.type = SDL_GPU_TEXTURETYPE_2D_ARRAY;
-    textureInfo.format = SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM;
+    textureInfo.format = m_format;
     textureInfo.width = m_size.w;
     textureInfo.height = m_size.h;
     textureInfo.layer_count_or_depth = 1;
     textureInfo.num_levels = 1;
-    textureInfo.usage = SDL_GPU_TEXTUREUSAGE_SAMPLER | SDL_GPU_TEXTUREUSAGE_COLOR_TARGET;
+    textureInfo.usage = usage;
+    // block compressed textures can only be copied into
+    if(BlockEncoder::isCompressed(m_format))
+        textureInfo.usage &= ~SDL_GPU_TEXTUREUSAGE_COLOR_TARGET;
     m_texture = SDL_CreateGPUTexture(g_painter->getDevice(), &textureInfo);
+    m_textureSize = m_size;
     m_gpuSize = m_size;
     setupTranformMatrix();
+    m_samplerChanged = false;
     updateSampler();
 }
 
@@ -34,65 +44,190 @@ void Texture::uploadPixels(const ImagePtr &imagePtr)
     m_image = imagePtr;
     m_size = m_gpuSize = m_image->getSize();
     setupTranformMatrix();
-    g_painter->addPendingTexture(shared_from_this());
+    g_painter->addPendingTexture(shared_from_this(), imagePtr);
+
+    // formats the GPU can't render to get their mip chain box filtered here instead, compressed images
+    // have no chain at all until the pipeline cooks one
+    if(m_hasMipMaps && !BlockEncoder::isCompressed(imagePtr->getFormat()) && !canGenerateMipmaps(imagePtr->getFormat())) {
+        ImagePtr level = imagePtr;
+        int levelCount = getMipLevelCount(m_size);
+        for(int i = 1; i < levelCount; ++i) {
+            level = level->generateMipmap();
+            g_painter->addPendingTexture(shared_from_this(), level, RectI(0, 0, level->getSize()), i);
+        }
+    }
 }
 
-void Texture::upload(SDL_GPUCommandBuffer* commandBuffer)
+void Texture::setSmooth(bool smooth)
 {
-    SDL_GPUTextureCreateInfo textureInfo;
-    SDL_zero(textureInfo);
-    textureInfo.type = SDL_GPU_TEXTURETYPE_2D_ARRAY;
-    textureInfo.format = SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM;
-    textureInfo.width = m_image->getWidth();
-    textureInfo.height = m_image->getHeight();
-    textureInfo.layer_count_or_depth = 1;
-    textureInfo.num_levels = 1;
-    textureInfo.usage = SDL_GPU_TEXTUREUSAGE_SAMPLER;
+    m_smooth = smooth;
+    m_samplerChanged = true;
+}
 
-    m_texture = SDL_CreateGPUTexture(g_painter->getDevice(), &textureInfo);
-    updateSampler();
+void Texture::setMipmaps(bool mipmaps)
+{
+    m_hasMipMaps = mipmaps;
+    m_mipmapFilter = mipmaps;
+    m_samplerChanged = true;
+}
 
-    SDL_GPUTransferBufferCreateInfo tbInfo;
-    tbInfo.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
-    tbInfo.props = 0;
-    tbInfo.size = m_image->getPixelDataSize();
+void Texture::setMipmapFilter(bool linear)
+{
+    m_mipmapFilter = linear;
+    m_samplerChanged = true;
+}
 
-    SDL_GPUTransferBuffer* textureTransferBuffer = SDL_CreateGPUTransferBuffer(g_painter->getDevice(), &tbInfo);
-    uint8_t* textureData = (uint8_t*)SDL_MapGPUTransferBuffer(g_painter->getDevice(), textureTransferBuffer, false);
-    memcpy(textureData, m_image->getPixelData(), m_image->getPixelDataSize());
-    SDL_UnmapGPUTransferBuffer(g_painter->getDevice(), textureTransferBuffer);
+int Texture::getMipLevelCount(const SizeI& size)
+{
+    int levels = 1;
+    for(int extent = std::max(size.w, size.h); extent > 1; extent >>= 1)
+        ++levels;
+    return levels;
+}
 
-    SDL_GPUCopyPass* copyPass = SDL_BeginGPUCopyPass(commandBuffer);
+bool Texture::canGenerateMipmaps(SDL_GPUTextureFormat format)
+{
+    return SDL_GPUTextureSupportsFormat(g_painter->getDevice(), format, SDL_GPU_TEXTURETYPE_2D_ARRAY, SDL_GPU_TEXTUREUSAGE_SAMPLER | SDL_GPU_TEXTUREUSAGE_COLOR_TARGET);
+}
+
+bool Texture::takeMipmapGeneration()
+{
+    bool generate = m_mipmapsChanged;
+    m_mipmapsChanged = false;
+    return generate;
+}
+
+void Texture::updateRegion(const RectI& rect, const uint8_t* pixels, uint32_t pitch)
+{
+    RectI region = rect.intersection(RectI(0, 0, m_size));
+    if(!region.isValid() || !pixels)
+        return;
+
+    // only the changed rows are copied, the render thread uploads them later on
+    ImagePtr regionImage = ImagePtr(new Image(region.size()));
+    const uint8_t* source = pixels + (size_t)(region.y() - rect.y()) * pitch + (size_t)(region.x() - rect.x()) * 4;
+    for(int row = 0; row < region.height(); ++row)
+        memcpy(regionImage->getPixelData(0, row), source + (size_t)row * pitch, (size_t)region.width() * 4);
+    g_painter->addPendingTexture(shared_from_this(), regionImage, region);
+}
+
+void Texture::updateRegion(const RectI& rect, const Image& image, const PointI& source)
+{
+    RectI sourceRect = RectI(source, rect.size()).intersection(RectI(0, 0, image.getSize()));
+    if(!sourceRect.isValid())
+        return;
+    updateRegion(RectI(rect.topLeft() + (sourceRect.topLeft() - source), sourceRect.size()), image.getPixelData(sourceRect.x(), sourceRect.y()), image.getPitch());
+}
+
+void Texture::upload(SDL_GPUCopyPass* copyPass, const ImagePtr& image, const StagingAllocation& staging, const RectI& region, int level)
+{
+    if(!staging.buffer)
+        return;
+
+    // a region or a mip level lands in the texture as it is, without cycling, the rest of it has to survive
+    if(region.isValid() || level > 0) {
+        SizeI levelSize(std::max(m_textureSize.w >> level, 1), std::max(m_textureSize.h >> level, 1));
+        if(!m_texture || level >= m_textureLevels || !RectI(0, 0, levelSize).contains(region)) {
+            SDL_Log("Texture: region update of a texture that wasn't uploaded at that size.");
+            return;
+        }
+        if(image->getFormat() != m_format) {
+            SDL_Log("Texture: region update in a different format than the texture.");
+            return;
+        }
+
+        SDL_GPUTextureTransferInfo source;
+        SDL_zero(source);
+        source.offset = staging.offset;
+        source.transfer_buffer = staging.buffer;
+
+        SDL_GPUTextureRegion dest;
+        SDL_zero(dest);
+        dest.texture = m_texture;
+        dest.mip_level = level;
+        dest.x = region.x();
+        dest.y = region.y();
+        dest.w = region.width();
+        dest.h = region.height();
+        dest.d = 1;
+
+        SDL_UploadToGPUTexture(copyPass, &source, &dest, false);
+        if(level == 0 && m_textureLevels > 1 && m_gpuMipmaps)
+            m_mipmapsChanged = true;
+        return;
+    }
+
+    // same size re-uploads overwrite the texture in place, cycling it if an earlier frame still samples it
+    bool hasMipMaps = m_hasMipMaps;
+    int levelCount = hasMipMaps && !BlockEncoder::isCompressed(image->getFormat()) ? getMipLevelCount(image->getSize()) : 1;
+    bool inPlace = m_texture && m_textureSize == image->getSize() && m_textureLevels == levelCount && m_format == image->getFormat();
+    if(!inPlace) {
+        if(m_texture)
+            SDL_ReleaseGPUTexture(g_painter->getDevice(), m_texture);
+
+        SDL_GPUTextureCreateInfo textureInfo;
+        SDL_zero(textureInfo);
+        textureInfo.type = SDL_GPU_TEXTURETYPE_2D_ARRAY;
+        textureInfo.format = image->getFormat();
+        textureInfo.width = image->getWidth();
+        textureInfo.height = image->getHeight();
+        textureInfo.layer_count_or_depth = 1;
+        textureInfo.num_levels = levelCount;
+        textureInfo.usage = SDL_GPU_TEXTUREUSAGE_SAMPLER;
+        // the GPU builds the chain with blits, which needs a render target
+        m_gpuMipmaps = levelCount > 1 && canGenerateMipmaps(textureInfo.format);
+        if(m_gpuMipmaps)
+            textureInfo.usage |= SDL_GPU_TEXTUREUSAGE_COLOR_TARGET;
+
+        m_texture = SDL_CreateGPUTexture(g_painter->getDevice(), &textureInfo);
+        m_textureSize = image->getSize();
+        m_textureLevels = levelCount;
+        m_format = textureInfo.format;
+        if(!m_texture) {
+            SDL_Log("SDL_CreateGPUTexture: %s", SDL_GetError());
+            return;
+        }
+    }
+    if(m_samplerChanged.exchange(false) || !m_sampler)
+        updateSampler();
 
     SDL_GPUTextureTransferInfo tti;
-    tti.offset = 0;
+    tti.offset = staging.offset;
     tti.pixels_per_row = 0;
     tti.rows_per_layer = 0;
-    tti.transfer_buffer = textureTransferBuffer;
+    tti.transfer_buffer = staging.buffer;
 
     SDL_GPUTextureRegion dest;
     SDL_zero(dest);
     dest.texture = m_texture;
-    dest.w = m_image->getWidth();
-    dest.h = m_image->getHeight();
+    dest.w = image->getWidth();
+    dest.h = image->getHeight();
     dest.d = 1;
 
-    SDL_UploadToGPUTexture(copyPass, &tti, &dest, false);
-    SDL_EndGPUCopyPass(copyPass);
-    SDL_ReleaseGPUTransferBuffer(g_painter->getDevice(), textureTransferBuffer);
+    SDL_UploadToGPUTexture(copyPass, &tti, &dest, inPlace);
+    if(m_gpuMipmaps)
+        m_mipmapsChanged = true;
 }
 
 void Texture::updateSampler()
 {
+    // the recording thread may change them meanwhile, the sampler is built from one read of each
+    bool mipmapFilter = m_mipmapFilter;
+    bool smooth = m_smooth;
+    bool hasMipMaps = m_hasMipMaps;
+
     SDL_GPUSamplerCreateInfo samplerInfo;
     SDL_zero(samplerInfo);
-    samplerInfo.min_filter = m_mipmapFilter ? SDL_GPU_FILTER_LINEAR : SDL_GPU_FILTER_NEAREST;
-    samplerInfo.mag_filter = m_smooth ? SDL_GPU_FILTER_LINEAR : SDL_GPU_FILTER_NEAREST;
-    samplerInfo.mipmap_mode = m_mipmapFilter ? SDL_GPU_SAMPLERMIPMAPMODE_LINEAR : SDL_GPU_SAMPLERMIPMAPMODE_NEAREST;
+    samplerInfo.min_filter = mipmapFilter ? SDL_GPU_FILTER_LINEAR : SDL_GPU_FILTER_NEAREST;
+    samplerInfo.mag_filter = smooth ? SDL_GPU_FILTER_LINEAR : SDL_GPU_FILTER_NEAREST;
+    samplerInfo.mipmap_mode = mipmapFilter ? SDL_GPU_SAMPLERMIPMAPMODE_LINEAR : SDL_GPU_SAMPLERMIPMAPMODE_NEAREST;
     samplerInfo.address_mode_u = m_repeat ? SDL_GPU_SAMPLERADDRESSMODE_REPEAT : SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE;
     samplerInfo.address_mode_v = m_repeat ? SDL_GPU_SAMPLERADDRESSMODE_REPEAT : SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE;
     samplerInfo.address_mode_w = m_repeat ? SDL_GPU_SAMPLERADDRESSMODE_REPEAT : SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE;
-    
+    // without a chain only the base level may be sampled
+    samplerInfo.min_lod = 0.0f;
+    samplerInfo.max_lod = hasMipMaps ? 1000.0f : 0.0f;
+
     if(m_sampler)
         SDL_ReleaseGPUSampler(g_painter->getDevice(), m_sampler);
     m_sampler = SDL_CreateGPUSampler(g_painter->getDevice(), &samplerInfo);
@@ -109,6 +244,10 @@ void Texture::setupTranformMatrix()
 
 void Texture::bind(SDL_GPURenderPass* renderPass)
 {
+    // filters changed after the last upload still reach the sampler before it is used
+    if(m_samplerChanged.exchange(false) || !m_sampler)
+        updateSampler();
+
     static SDL_GPUTextureSamplerBinding binding;
     binding.texture = m_texture;
     binding.sampler = m_sampler;
@@ -4,6 +4,12 @@
 #include <utils/include.h>
 #include <utils/size.h>
 #include <utils/matrix.h>
+#include <utils/point.h>
+#include <utils/rect.h>
+
+#include <atomic>
+
+#include "stagingpool.h"
 
 class GPUCommand;
 class Texture : public std::enable_shared_from_this<Texture> {
@@ -14,13 +20,33 @@ public:
     const Matrix3& getTransformMatrix() const { return m_transformMatrix; }
 
     SizeI getSize() const { return m_size; }
-    void setSize(const SizeI& size) { m_size = size; }
+    void setSize(const SizeI& size) { m_size = m_gpuSize = size; }
+
+    void setSmooth(bool smooth);
 
-    void setSmooth(bool smooth) { m_smooth = smooth; }
+    // builds a mip chain on the next full upload, minified draws then sample a level close to their size
+    void setMipmaps(bool mipmaps);
+    bool hasMipmaps() const { return m_hasMipMaps; }
+    // linear blends between the two nearest levels, otherwise the nearest one is used
+    void setMipmapFilter(bool linear);
 
-    void generate();
+    // what generate() creates; uploaded textures take the format of their image
+    SDL_GPUTextureFormat getFormat() const { return m_format; }
+    void setFormat(SDL_GPUTextureFormat format) { m_format = format; }
+
+    // render targets by default; block compressed formats never get COLOR_TARGET
+    void generate(SDL_GPUTextureUsageFlags usage = SDL_GPU_TEXTUREUSAGE_SAMPLER | SDL_GPU_TEXTUREUSAGE_COLOR_TARGET);
     void uploadPixels(const ImagePtr& imagePtr);
-    void upload(SDL_GPUCommandBuffer* commandBuffer);
+    // replaces only rect of an already uploaded texture, pixels are RGBA8 rows pitch bytes apart
+    void updateRegion(const RectI& rect, const uint8_t* pixels, uint32_t pitch);
+    void updateRegion(const RectI& rect, const Image& image, const PointI& source = PointI(0, 0));
+    // image was staged into staging; the GPU texture is only created again when the size changed
+    void upload(SDL_GPUCopyPass* copyPass, const ImagePtr& image, const StagingAllocation& staging, const RectI& region = RectI(), int level = 0);
+    // true once after an upload that left the GPU generated mip levels stale
+    bool takeMipmapGeneration();
+
+    static int getMipLevelCount(const SizeI& size);
+    static bool canGenerateMipmaps(SDL_GPUTextureFormat format);
     void updateSampler();
     void setupTranformMatrix();
 
@@ -31,17 +57,24 @@ private:
     Matrix3 m_transformMatrix;
     SizeI m_gpuSize;
     SizeI m_size;
+    SizeI m_textureSize; // what m_texture was created with
+    int m_textureLevels = 1;
 
     ImagePtr m_image = nullptr;
     SDL_GPUTexture* m_texture = nullptr;
     SDL_GPUSampler* m_sampler = nullptr;
+    SDL_GPUTextureFormat m_format = SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM;
 
     bool m_repeat = false;
-    bool m_mipmapFilter = false;
     bool m_hasPixels = false;
-    bool m_hasMipMaps = false;
-    bool m_smooth = false;
     bool m_opaque = false;
+    bool m_gpuMipmaps = false;
+    bool m_mipmapsChanged = false;
+    // set by the recording thread, the thread encoding frames rebuilds the sampler at its next bind or upload
+    std::atomic<bool> m_mipmapFilter{false};
+    std::atomic<bool> m_hasMipMaps{false};
+    std::atomic<bool> m_smooth{false};
+    std::atomic<bool> m_samplerChanged{false};
 };
 
 #endif
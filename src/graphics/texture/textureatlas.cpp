@@ -0,0 +1,169 @@
+#include "textureatlas.h"
+#include "texture.h"
+
+#include <graphics/image.h>
+
+#include <climits>
+#include <cstring>
+
+AtlasRegionPtr TextureAtlas::add(const ImagePtr& image)
+{
+    if(!image)
+        return nullptr;
+
+    // pages are RGBA8, anything else can't be blitted into them
+    if(image->getFormat() != SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM) {
+        SDL_Log("TextureAtlas: only RGBA8 images can be packed.");
+        return nullptr;
+    }
+
+    int width = (int)image->getWidth();
+    int height = (int)image->getHeight();
+    if(width <= 0 || height <= 0 || width > MaxRegionSize || height > MaxRegionSize)
+        return nullptr;
+
+    // the padding on every side repeats the edge, so filtered samples never reach the neighbour
+    int paddedWidth = width + Padding * 2;
+    int paddedHeight = height + Padding * 2;
+    PointI position;
+    Page* page = nullptr;
+    for(Page& candidate : m_pages) {
+        if(insert(candidate, paddedWidth, paddedHeight, position)) {
+            page = &candidate;
+            break;
+        }
+    }
+
+    if(!page) {
+        Page& newPage = m_pages.emplace_back();
+        newPage.texture = TexturePtr(new Texture);
+        // regions drawn before the page's first upload already need its uvs
+        newPage.texture->setSize(SizeI(PageSize, PageSize));
+        newPage.texture->setupTranformMatrix();
+        newPage.image = ImagePtr(new Image(PageSize, PageSize));
+        newPage.skyline.push_back({ 0, 0, PageSize });
+        if(!insert(newPage, paddedWidth, paddedHeight, position))
+            return nullptr;
+        page = &newPage;
+    }
+
+    // a page on the GPU only gets the new rect, one that never went up is uploaded whole at flush
+    ImagePtr padded = extrude(*image);
+    if(page->image)
+        page->image->blit(position.x, position.y, *padded);
+    else
+        page->texture->updateRegion(RectI(position.x, position.y, paddedWidth, paddedHeight), *padded);
+
+    AtlasRegionPtr region = std::make_shared<AtlasRegion>();
+    region->page = page->texture;
+    region->rect = RectI(position.x + Padding, position.y + Padding, width, height);
+    return region;
+}
+
+ImagePtr TextureAtlas::extrude(const Image& image)
+{
+    int width = (int)image.getWidth();
+    int height = (int)image.getHeight();
+    ImagePtr padded = ImagePtr(new Image(width + Padding * 2, height + Padding * 2));
+    padded->blit(Padding, Padding, image);
+
+    for(int y = 0; y < height; ++y) {
+        uint8_t* row = padded->getPixelData(0, y + Padding);
+        for(int i = 0; i < Padding; ++i) {
+            memcpy(row + i * 4, row + Padding * 4, 4);
+            memcpy(row + (Padding + width + i) * 4, row + (Padding + width - 1) * 4, 4);
+        }
+    }
+
+    size_t pitch = (size_t)padded->getPitch();
+    for(int i = 0; i < Padding; ++i) {
+        memcpy(padded->getPixelData(0, i), padded->getPixelData(0, Padding), pitch);
+        memcpy(padded->getPixelData(0, Padding + height + i), padded->getPixelData(0, Padding + height - 1), pitch);
+    }
+    return padded;
+}
+
+void TextureAtlas::flush()
+{
+    for(Page& page : m_pages) {
+        if(!page.image)
+            continue;
+        // the render thread reads the pixels later on, later adds go through region updates instead
+        page.texture->uploadPixels(page.image);
+        page.image = nullptr;
+    }
+}
+
+void TextureAtlas::clear()
+{
+    m_pages.clear();
+}
+
+int TextureAtlas::fit(const Page& page, size_t index, int width, int height)
+{
+    // the lowest y a rect can sit at when its left edge is on this node
+    int x = page.skyline[index].x;
+    if(x + width > PageSize)
+        return -1;
+
+    int y = 0;
+    int widthLeft = width;
+    for(size_t i = index; widthLeft > 0; ++i) {
+        if(i >= page.skyline.size())
+            return -1;
+        y = std::max(y, page.skyline[i].y);
+        if(y + height > PageSize)
+            return -1;
+        widthLeft -= page.skyline[i].width;
+    }
+    return y;
+}
+
+bool TextureAtlas::insert(Page& page, int width, int height, PointI& position)
+{
+    // bottom left rule: lowest top edge wins, the narrower node breaks ties so less space is wasted
+    int bestIndex = -1;
+    int bestBottom = INT_MAX;
+    int bestWidth = INT_MAX;
+    for(size_t i = 0; i < page.skyline.size(); ++i) {
+        int y = fit(page, i, width, height);
+        if(y < 0)
+            continue;
+        if(y + height < bestBottom || (y + height == bestBottom && page.skyline[i].width < bestWidth)) {
+            bestIndex = (int)i;
+            bestBottom = y + height;
+            bestWidth = page.skyline[i].width;
+            position = PointI(page.skyline[i].x, y);
+        }
+    }
+
+    if(bestIndex < 0)
+        return false;
+
+    page.skyline.insert(page.skyline.begin() + bestIndex, { position.x, position.y + height, width });
+
+    // nodes now under the new one shrink or go away
+    for(size_t i = bestIndex + 1; i < page.skyline.size();) {
+        SkylineNode& previous = page.skyline[i - 1];
+        SkylineNode& node = page.skyline[i];
+        int overlap = previous.x + previous.width - node.x;
+        if(overlap <= 0)
+            break;
+        if(overlap < node.width) {
+            node.x += overlap;
+            node.width -= overlap;
+            break;
+        }
+        page.skyline.erase(page.skyline.begin() + i);
+    }
+
+    // neighbours at the same height become one node
+    for(size_t i = 0; i + 1 < page.skyline.size();) {
+        if(page.skyline[i].y == page.skyline[i + 1].y) {
+            page.skyline[i].width += page.skyline[i + 1].width;
+            page.skyline.erase(page.skyline.begin() + i + 1);
+        } else
+            ++i;
+    }
+    return true;
+}
@@ -0,0 +1,52 @@
+#ifndef TEXTUREATLAS_H
+#define TEXTUREATLAS_H
+
+#include <utils/include.h>
+#include <utils/point.h>
+#include <utils/rect.h>
+
+// A packed image: a rect of one atlas page. Draws through Painter::drawTexturedRect(s), so
+// everything on the same page batches into one command with one texture bind.
+struct AtlasRegion {
+    TexturePtr page;
+    RectI rect;
+};
+
+// Packs small images into a few large pages with a skyline packer. A new page is uploaded
+// whole at the next flush, images added to it afterwards only upload their own rect.
+class TextureAtlas {
+public:
+    // nullptr when the image is too big to be worth packing or isn't RGBA8, draw it as its own texture then
+    AtlasRegionPtr add(const ImagePtr& image);
+    // queues the pages created since the last flush for upload, once per frame
+    void flush();
+    void clear();
+
+    size_t getPageCount() const { return m_pages.size(); }
+
+private:
+    enum {
+        PageSize = 2048,
+        MaxRegionSize = 512,
+        Padding = 1
+    };
+
+    struct SkylineNode {
+        int x, y, width;
+    };
+
+    struct Page {
+        TexturePtr texture;
+        ImagePtr image; // pixels of a page that wasn't uploaded yet
+        std::vector<SkylineNode> skyline;
+    };
+
+    // the image with its edge pixels repeated Padding times around it
+    static ImagePtr extrude(const Image& image);
+    static bool insert(Page& page, int width, int height, PointI& position);
+    static int fit(const Page& page, size_t index, int width, int height);
+
+    std::vector<Page> m_pages;
+};
+
+#endif
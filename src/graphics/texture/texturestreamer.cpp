@@ -0,0 +1,140 @@
+#include "texturestreamer.h"
+#include "texture.h"
+
+#include <graphics/image.h>
+#include <graphics/painter.h>
+#include <utils/threadpool.h>
+
+TextureStreamer::~TextureStreamer()
+{
+    stop();
+}
+
+void TextureStreamer::start(ThreadPool& threadPool)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_threadPool = &threadPool;
+    m_stopping = false;
+}
+
+void TextureStreamer::stop()
+{
+    // tasks already on the pool find nothing left to do, the ones running finish first
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_stopping = true;
+    m_idle.wait(lock, [this] { return m_pendingTasks == 0; });
+    m_threadPool = nullptr;
+
+    for(Job& job : m_jobs)
+        job.texture->m_state = StreamedTexture::Failed;
+    m_jobs.clear();
+    for(StreamedTexturePtr& texture : m_staged) {
+        texture->m_image = nullptr;
+        texture->m_state = StreamedTexture::Failed;
+    }
+    m_staged.clear();
+    m_placeholder = nullptr;
+}
+
+StreamedTexturePtr TextureStreamer::load(const std::function<ImagePtr()>& decode)
+{
+    StreamedTexturePtr texture = std::make_shared<StreamedTexture>();
+    texture->m_placeholder = getPlaceholder();
+
+    // without workers the caller pays for the decode, the upload is still spread over frames
+    if(!m_threadPool || m_threadPool->getWorkerCount() == 0) {
+        if(!stage(*texture, decode()))
+            return texture;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_staged.push_back(texture);
+        return texture;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back({ texture, decode });
+        ++m_pendingTasks;
+    }
+    // one task per job, each takes whichever job is oldest when it runs
+    m_threadPool->enqueue([this] { runJob(); });
+    return texture;
+}
+
+void TextureStreamer::update()
+{
+    size_t bytes = 0;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    while(!m_staged.empty()) {
+        StreamedTexturePtr& texture = m_staged.front();
+        if(bytes > 0 && bytes + texture->m_bytes > m_uploadBudget)
+            break;
+        bytes += texture->m_bytes;
+
+        // resident right away: anything recorded from now on belongs to this frame or a later one,
+        // and the frame's texture uploads run before its first pass
+        g_painter->addPendingTexture(texture->m_texture, texture->m_image);
+        texture->m_image = nullptr;
+        texture->m_state = StreamedTexture::Resident;
+        m_staged.pop_front();
+    }
+}
+
+void TextureStreamer::runJob()
+{
+    Job job;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(!m_stopping && !m_jobs.empty()) {
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+    }
+
+    bool staged = job.texture && stage(*job.texture, job.decode());
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(staged)
+            m_staged.push_back(std::move(job.texture));
+        // notified under the lock, stop() may destroy the streamer as soon as it sees the count drop
+        --m_pendingTasks;
+        m_idle.notify_all();
+    }
+}
+
+bool TextureStreamer::stage(StreamedTexture& streamed, const ImagePtr& image)
+{
+    if(!image || image->getPixelDataSize() == 0) {
+        streamed.m_state = StreamedTexture::Failed;
+        return false;
+    }
+
+    // creating the texture doesn't need a command buffer, so the worker does it; the pixels are copied
+    // into transfer memory by the thread encoding the frame that uploads them
+    TexturePtr texture = TexturePtr(new Texture);
+    texture->setSize(image->getSize());
+    texture->setFormat(image->getFormat());
+    // streamed textures are only copied into and sampled, they never need to be a render target
+    texture->generate(SDL_GPU_TEXTUREUSAGE_SAMPLER);
+    if(!texture->get()) {
+        SDL_Log("TextureStreamer: %s", SDL_GetError());
+        streamed.m_state = StreamedTexture::Failed;
+        return false;
+    }
+
+    streamed.m_texture = texture;
+    streamed.m_image = image;
+    streamed.m_bytes = (uint32_t)image->getPixelDataSize();
+    streamed.m_state = StreamedTexture::Staged;
+    return true;
+}
+
+const TexturePtr& TextureStreamer::getPlaceholder()
+{
+    // one transparent texel, drawn in place of every texture that isn't resident yet
+    if(!m_placeholder) {
+        m_placeholder = TexturePtr(new Texture);
+        m_placeholder->uploadPixels(ImagePtr(new Image(1, 1)));
+    }
+    return m_placeholder;
+}
@@ -0,0 +1,85 @@
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include <utils/include.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+class ThreadPool;
+
+// Handle to a texture loading in the background. Draw getTexture(): it is the shared placeholder
+// until the pixels are on the GPU, and the decision is made at record time, so a frame never
+// samples a texture whose upload it doesn't also contain or follow.
+class StreamedTexture {
+public:
+    const TexturePtr& getTexture() const { return m_state.load() == Resident ? m_texture : m_placeholder; }
+    bool isResident() const { return m_state.load() == Resident; }
+    bool hasFailed() const { return m_state.load() == Failed; }
+
+private:
+    friend class TextureStreamer;
+
+    enum State {
+        Loading,
+        Staged,
+        Resident,
+        Failed
+    };
+
+    TexturePtr m_texture;
+    TexturePtr m_placeholder;
+    ImagePtr m_image; // decoded pixels until update() queues them on a frame
+    uint32_t m_bytes = 0;
+    std::atomic<int> m_state{Loading};
+};
+using StreamedTexturePtr = std::shared_ptr<StreamedTexture>;
+
+// Decodes textures as tasks on a thread pool; update() queues the decoded ones as uploads of the frame
+// being recorded without going over the per frame byte budget. They are staged with the frame's other
+// texture uploads, in the pooled transfer memory of the thread encoding it.
+class TextureStreamer {
+public:
+    ~TextureStreamer();
+
+    // the pool has to outlive stop()
+    void start(ThreadPool& threadPool);
+    // drops queued work, waits for the decodes already running and drops what was decoded but never uploaded
+    void stop();
+
+    // call from the main thread; decode runs on a pool worker and may take as long as it needs,
+    // a null image marks the texture failed
+    StreamedTexturePtr load(const std::function<ImagePtr()>& decode);
+    // once per frame on the main thread
+    void update();
+
+    // a staged texture bigger than the budget still goes alone, so nothing starves
+    void setUploadBudget(size_t bytesPerFrame) { m_uploadBudget = bytesPerFrame; }
+    size_t getUploadBudget() const { return m_uploadBudget; }
+    void setPlaceholder(const TexturePtr& placeholder) { m_placeholder = placeholder; }
+
+private:
+    struct Job {
+        StreamedTexturePtr texture;
+        std::function<ImagePtr()> decode;
+    };
+
+    void runJob();
+    bool stage(StreamedTexture& texture, const ImagePtr& image);
+    const TexturePtr& getPlaceholder();
+
+    ThreadPool* m_threadPool = nullptr;
+    std::mutex m_mutex;
+    std::condition_variable m_idle;
+    std::deque<Job> m_jobs;
+    size_t m_pendingTasks = 0; // queued on the pool and not finished yet
+    std::deque<StreamedTexturePtr> m_staged;
+    TexturePtr m_placeholder;
+    size_t m_uploadBudget = 4 * 1024 * 1024;
+    bool m_stopping = false;
+};
+
+#endif
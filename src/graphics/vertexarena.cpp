@@ -0,0 +1,107 @@
+#include "vertexarena.h"
+#include "painter.h"
+
+VertexArena::~VertexArena()
+{
+    release();
+}
+
+void VertexArena::release()
+{
+    unmap();
+    if(m_transferBuffer) {
+        SDL_ReleaseGPUTransferBuffer(g_painter->getDevice(), m_transferBuffer);
+        m_transferBuffer = nullptr;
+    }
+    m_heap.reset();
+    m_data = nullptr;
+    m_size = 0;
+    m_capacity = 0;
+    m_transferCapacity = 0;
+}
+
+void VertexArena::unmap()
+{
+    if(m_transferBuffer && m_data) {
+        SDL_UnmapGPUTransferBuffer(g_painter->getDevice(), m_transferBuffer);
+        m_data = nullptr;
+        m_capacity = 0;
+    }
+}
+
+bool VertexArena::map(size_t capacity)
+{
+    if(!m_transferBuffer || m_transferCapacity < capacity) {
+        SDL_GPUTransferBufferCreateInfo tbInfo;
+        SDL_zero(tbInfo);
+        tbInfo.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
+        tbInfo.size = (uint32_t)capacity;
+
+        SDL_GPUTransferBuffer* transferBuffer = SDL_CreateGPUTransferBuffer(g_painter->getDevice(), &tbInfo);
+        if(!transferBuffer) {
+            SDL_Log("Error transfering buffer: %s", SDL_GetError());
+            return false;
+        }
+
+        void* map = SDL_MapGPUTransferBuffer(g_painter->getDevice(), transferBuffer, false);
+        if(!map) {
+            SDL_Log("SDL_MapGPUTransferBuffer: %s", SDL_GetError());
+            SDL_ReleaseGPUTransferBuffer(g_painter->getDevice(), transferBuffer);
+            return false;
+        }
+
+        // relocate what was recorded so far, the old buffer is released once the GPU is done with it
+        if(m_data && m_size > 0)
+            memcpy(map, m_data, m_size);
+        unmap();
+        if(m_transferBuffer)
+            SDL_ReleaseGPUTransferBuffer(g_painter->getDevice(), m_transferBuffer);
+
+        m_transferBuffer = transferBuffer;
+        m_transferCapacity = capacity;
+        m_data = static_cast<unsigned char*>(map);
+    } else {
+        // a new recording: cycling hands out fresh memory if the GPU still reads the last one
+        void* map = SDL_MapGPUTransferBuffer(g_painter->getDevice(), m_transferBuffer, true);
+        if(!map) {
+            SDL_Log("SDL_MapGPUTransferBuffer: %s", SDL_GetError());
+            return false;
+        }
+        m_data = static_cast<unsigned char*>(map);
+    }
+
+    m_capacity = m_transferCapacity;
+    return true;
+}
+
+void VertexArena::grow(size_t size)
+{
+    size_t capacity = std::max<size_t>(std::max<size_t>(m_capacity, m_transferCapacity), InitialCapacity);
+    while(capacity < size)
+        capacity *= 2;
+
+    if(m_mapped) {
+        if(map(capacity))
+            return;
+        // no transfer memory available, keep recording on the heap and let the upload stage it
+        SDL_Log("VertexArena: falling back to heap memory.");
+        m_mapped = false;
+        std::unique_ptr<unsigned char[]> heap(new unsigned char[capacity]);
+        if(m_data && m_size > 0)
+            memcpy(heap.get(), m_data, m_size);
+        size_t size = m_size;
+        release();
+        m_heap = std::move(heap);
+        m_data = m_heap.get();
+        m_size = size;
+        m_capacity = capacity;
+        return;
+    }
+
+    std::unique_ptr<unsigned char[]> heap(new unsigned char[capacity]);
+    if(m_data && m_size > 0)
+        memcpy(heap.get(), m_data, m_size);
+    m_heap = std::move(heap);
+    m_data = m_heap.get();
+    m_capacity = capacity;
+}
@@ -0,0 +1,60 @@
+#ifndef VERTEXARENA_H
+#define VERTEXARENA_H
+
+#include <utils/include.h>
+
+// Byte arena the painter records vertices into. In mapped mode the bytes live in an SDL transfer
+// buffer that stays mapped while the pass records, so the render thread uploads straight from it
+// with no staging copy. Growth relocates into a transfer buffer twice the size. Heap mode backs
+// worker recording contexts, whose vertices are spliced into a mapped arena later.
+class VertexArena {
+public:
+    enum {
+        InitialCapacity = 64 * 1024
+    };
+
+    explicit VertexArena(bool mapped = false) : m_mapped(mapped) { }
+    ~VertexArena();
+
+    VertexArena(const VertexArena&) = delete;
+    VertexArena& operator=(const VertexArena&) = delete;
+
+    size_t add(size_t count) {
+        size_t index = m_size;
+        if(m_size + count > m_capacity || !m_data)
+            grow(m_size + count);
+        m_size += count;
+        return index;
+    }
+
+    void reset() { m_size = 0; }
+    size_t size() const { return m_size; }
+    const unsigned char* data() const { return m_data; }
+
+    template<typename T>
+    T& at(size_t index) { return reinterpret_cast<T&>(m_data[index]); }
+
+    unsigned char& operator[](size_t index) { return m_data[index]; }
+
+    // ends the recording, in mapped mode the bytes can't be read or written until the next reset
+    void unmap();
+
+    // set when the bytes were recorded straight into transfer memory
+    SDL_GPUTransferBuffer* getTransferBuffer() const { return m_transferBuffer; }
+
+    void release();
+
+private:
+    void grow(size_t size);
+    bool map(size_t capacity);
+
+    bool m_mapped;
+    SDL_GPUTransferBuffer* m_transferBuffer = nullptr;
+    std::unique_ptr<unsigned char[]> m_heap;
+    unsigned char* m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_capacity = 0;
+    size_t m_transferCapacity = 0;
+};
+
+#endif
@@ -37,8 +37,107 @@ PointF animatedOffset(float amplitude = 10.f, float speed = 1.f) {
 }
 
 void UIWidget::draw(PointF offset)
+{
+    if(m_cachedLayer && m_layerValid) {
+        m_frameBuffer->draw(m_rect.toRectF().translated(offset));
+        return;
+    }
+    drawContent(offset);
+}
+
+void UIWidget::drawContent(PointF offset)
+{
+    RectF drawRect = drawSelf(offset);
+    drawChildren(offset + drawRect.topLeft().toPointF(), 0, m_children.size());
+}
+
+void UIWidget::updateLayers(RenderGraph& graph, std::vector<RenderGraph::ResourceId>& layers)
+{
+    if(!m_subtreeChanged)
+        return;
+
+    // inner layers become inputs of this one, so the graph renders them first
+    if(!m_cachedLayer) {
+        for(UIWidget* child : m_children)
+            child->updateLayers(graph, layers);
+        return;
+    }
+
+    std::vector<RenderGraph::ResourceId> childLayers;
+    for(UIWidget* child : m_children)
+        child->updateLayers(graph, childLayers);
+    addLayerPass(graph, childLayers, layers);
+}
+
+void UIWidget::addLayerPass(RenderGraph& graph, const std::vector<RenderGraph::ResourceId>& childLayers, std::vector<RenderGraph::ResourceId>& layers)
+{
+    if(!m_rect.size().isValid()) {
+        m_layerValid = false;
+        return;
+    }
+
+    if(!m_frameBuffer)
+        m_frameBuffer = FrameBufferPtr(new FrameBuffer());
+    m_frameBuffer->resize(m_rect.size());
+
+    // the layer holds the subtree at its own origin, anything outside the widget rect is clipped
+    RenderGraph::ResourceId layer = graph.importTarget(m_frameBuffer);
+    graph.addPass(layer, childLayers, [this]() {
+        drawContent(PointF(-m_rect.x(), -m_rect.y()));
+    });
+    layers.push_back(layer);
+    m_layerValid = true;
+}
+
+void UIWidget::setCachedLayer(bool cachedLayer)
+{
+    if(m_cachedLayer == cachedLayer)
+        return;
+    m_cachedLayer = cachedLayer;
+    m_layerValid = false;
+    if(!cachedLayer)
+        m_frameBuffer = nullptr;
+    invalidateSubtree();
+}
+
+RectF UIWidget::drawSelf(PointF offset)
 {
     RectF drawRect = m_rect.toRectF().translated(offset);
+
+    // a list recorded under another state (resolution, projection...) can't be replayed as is;
+    // compared in full, two states sharing a hash must not share a list
+    const PainterState& state = g_painter->getRecordingContext().getState();
+    if(m_update || !state.equals(m_displayListState)) {
+        record();
+        m_displayListState = state;
+        m_background.invalidate();
+    }
+
+    // a widget drawn where it was the frame before replays its background from its own GPU buffer,
+    // a moving one copies the list's vertices into the frame at the new position
+    PointF position = drawRect.topLeft().toPointF();
+    if(position == m_backgroundPosition) {
+        if(!m_background.isValid()) {
+            m_background.begin();
+            g_painter->splice(m_displayList, position);
+            m_background.end();
+        }
+        g_painter->drawRetained(m_background);
+    } else {
+        m_background.invalidate();
+        m_backgroundPosition = position;
+        g_painter->splice(m_displayList, position);
+    }
+    m_subtreeChanged = false;
+    return drawRect;
+}
+
+void UIWidget::record()
+{
+    // one scratch context per thread, only the compact copy is kept by the widget
+    static thread_local RecordingContext context;
+    context.begin(g_painter->getRecordingContext().getState());
+    context.bind();
     {
         // m_frameBuffer->bind();
         // g_painter->clear(Color(0.0f, 0.0f, 0.0f, 0.0f));
@@ -46,22 +145,58 @@ void UIWidget::draw(PointF offset)
         // g_painter->drawFilledRect(RectF(0,0, drawRect.size()));
         // m_frameBuffer->release();
         // m_frameBuffer->draw(drawRect);
-        g_painter->drawFilledRect(drawRect);
+        g_painter->drawFilledRect(RectF(PointF(0, 0), m_rect.size().toSizeF()));
     }
+    context.unbind();
 
-    for(UIWidget* child : m_children) {
-        PointF childOffset = offset + drawRect.topLeft().toPointF();
+    m_displayList.capture(context);
+    m_update = false;
+}
+
+void UIWidget::drawChildren(PointF offset, size_t begin, size_t end)
+{
+    for(size_t i = begin; i < end; ++i) {
+        PointF childOffset = offset;
         childOffset += animatedOffset(10, 4);
-        child->draw(childOffset);
+        m_children[i]->draw(childOffset);
     }
 }
 
-void UIWidget::resize(int width, int height)
+void UIWidget::invalidate()
 {
-    m_rect = RectI(m_rect.topLeft(), SizeI(width, height));
     m_update = true;
-    m_frameBuffer = FrameBufferPtr(new FrameBuffer());
-    m_frameBuffer->resize(m_rect.size());
+    invalidateSubtree();
+}
+
+void UIWidget::invalidateSubtree()
+{
+    for(UIWidget* widget = this; widget; widget = widget->m_parent)
+        widget->m_subtreeChanged = true;
+}
+
+void UIWidget::setRect(const RectI& rect)
+{
+    // the list is relative to the widget origin, moving the widget doesn't record it again
+    bool resized = rect.size() != m_rect.size();
+    m_rect = rect;
+    if(resized)
+        invalidate();
+    else if(m_parent)
+        m_parent->invalidateSubtree();
+}
+
+void UIWidget::setColor(const Color& color)
+{
+    if(color == m_color)
+        return;
+    m_color = color;
+    invalidate();
+}
+
+void UIWidget::resize(int width, int height)
+{
+    // a cached layer picks the new size up from the render target pool when it renders again
+    setRect(RectI(m_rect.topLeft(), SizeI(width, height)));
 }
 
 void UIWidget::addChild(const RectI& rect, const Color& color)
@@ -69,8 +204,10 @@ void UIWidget::addChild(const RectI& rect, const Color& color)
     UIWidget *widget = new UIWidget;
     widget->setRect(rect);
     widget->setColor(color);
+    widget->m_parent = this;
 
     m_children.push_back(widget);
+    invalidateSubtree();
 }
 
 void UIManager::init()
@@ -88,7 +225,36 @@ void UIManager::terminate()
 
 void UIManager::render()
 {
-    m_rootWidget->draw(PointF(5, 5));
+    // stale layers render first, each into its own offscreen pass
+    m_layers.clear();
+    m_rootWidget->updateLayers(m_renderGraph, m_layers);
+    m_renderGraph.execute();
+
+    PointF offset(5, 5);
+    size_t childCount = m_rootWidget->getChildCount();
+    ThreadPool& threadPool = g_painter->getThreadPool();
+    size_t contextCount = std::min(childCount / MinChildrenPerContext, threadPool.getThreadCount());
+    if(contextCount < 2) {
+        m_rootWidget->draw(offset);
+        return;
+    }
+
+    RectF drawRect = m_rootWidget->drawSelf(offset);
+    PointF childOffset = offset + drawRect.topLeft().toPointF();
+
+    // each slice of the root's children records on its own thread, splicing in slice order keeps the draw order
+    m_recordingContexts.resize(contextCount);
+    const PainterState& state = g_painter->getRecordingContext().getState();
+    threadPool.parallelFor(contextCount, [&](size_t index) {
+        RecordingContext& context = m_recordingContexts[index];
+        context.begin(state);
+        context.bind();
+        m_rootWidget->drawChildren(childOffset, childCount * index / contextCount, childCount * (index + 1) / contextCount);
+        context.unbind();
+    });
+
+    for(const RecordingContext& context : m_recordingContexts)
+        g_painter->splice(context);
 }
 
 void UIManager::resize(const SizeI &size)
@@ -6,6 +6,10 @@
 #include <utils/rect.h>
 #include <utils/point.h>
 #include <utils/size.h>
+#include <graphics/recordingcontext.h>
+#include <graphics/displaylist.h>
+#include <graphics/rendergraph.h>
+#include <graphics/retainedgeometry.h>
 
 #include <vector>
 
@@ -19,6 +23,18 @@ public:
     void destroy();
 
     void draw(PointF offset = PointF(0, 0));
+    // returns the rect it was drawn at, children are drawn relative to it
+    RectF drawSelf(PointF offset);
+    void drawChildren(PointF offset, size_t begin, size_t end);
+
+    // adds a pass for every stale cached layer below, the layers it wrote are added to layers
+    void updateLayers(RenderGraph& graph, std::vector<RenderGraph::ResourceId>& layers);
+
+    // the display list is recorded again on the next draw, ancestors learn that their subtree changed
+    void invalidate();
+    // set on the widget and its ancestors whenever anything below changed, cleared once drawn
+    void invalidateSubtree();
+    bool isSubtreeChanged() const { return m_subtreeChanged; }
 
     void resize(int width, int height);
 
@@ -27,24 +43,42 @@ public:
     TexturePtr getTexture() const { return m_texture; }
     const std::vector<UIWidget*>& getChildren() const { return m_children; }
     uint32_t getChildCount() const { return (uint32_t)m_children.size(); }
-    void clearChildren() { m_children.clear(); }
+    void clearChildren() { m_children.clear(); invalidate(); }
 
 public:
     void setSize(const SizeI& size) { resize(size.w, size.h); }
 
     RectI getRect() const { return m_rect; }
-    void setRect(const RectI& rect) { m_rect = rect; }
+    void setRect(const RectI& rect);
 
     Color getColor() const { return m_color; }
-    void setColor(const Color& color) { m_color = color; }
+    void setColor(const Color& color);
+
+    UIWidget* getParent() const { return m_parent; }
+
+    // the widget and its children render into a texture once and are drawn as one quad until something below changes
+    bool isCachedLayer() const { return m_cachedLayer; }
+    void setCachedLayer(bool cachedLayer);
 
 private:
+    void record();
+    void drawContent(PointF offset);
+    void addLayerPass(RenderGraph& graph, const std::vector<RenderGraph::ResourceId>& childLayers, std::vector<RenderGraph::ResourceId>& layers);
+
     std::vector<UIWidget*> m_children;
+    UIWidget* m_parent = nullptr;
+    DisplayList m_displayList; // own draws relative to the widget origin, children are not part of it
+    PainterState m_displayListState; // the state the list was recorded from
+    RetainedGeometry m_background; // the display list at m_backgroundPosition, kept on the GPU while the widget stays there
+    PointF m_backgroundPosition;
     FrameBufferPtr m_frameBuffer = nullptr;
     TexturePtr m_texture;
     RectI m_rect;
     Color m_color;
-    bool m_update = false;
+    bool m_update = true;
+    bool m_subtreeChanged = true;
+    bool m_cachedLayer = false;
+    bool m_layerValid = false;
 };
 
 class UIManager {
@@ -58,8 +92,14 @@ public:
     UIWidget* getRootWidget() const { return m_rootWidget; }
 
 private:
-    UIWidget* m_rootWidget;
+    enum {
+        MinChildrenPerContext = 256
+    };
 
+    UIWidget* m_rootWidget;
+    RenderGraph m_renderGraph;
+    std::vector<RenderGraph::ResourceId> m_layers;
+    std::vector<RecordingContext> m_recordingContexts;
 };
 
 #endif
@@ -28,6 +28,12 @@ using BufferManagerPtr = std::shared_ptr<BufferManager>;
 class RenderBuffer;
 using RenderBufferPtr = std::shared_ptr<RenderBuffer>;
 
+struct RetainedBlock;
+using RetainedBlockPtr = std::shared_ptr<RetainedBlock>;
+
+struct AtlasRegion;
+using AtlasRegionPtr = std::shared_ptr<AtlasRegion>;
+
 enum TriangleDrawMode {
     DrawTriangles = 1000,
     DrawTriangleFan,
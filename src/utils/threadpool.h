@@ -0,0 +1,132 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fork-join pool: parallelFor hands out indices to the workers and the calling thread and returns once all ran.
+// Background tasks queued with enqueue run on idle workers; a parallelFor never waits for one, workers stuck
+// in a long task simply leave their share of the indices to the others.
+class ThreadPool {
+public:
+    // 0 picks one worker per extra hardware thread
+    explicit ThreadPool(size_t workers = 0) {
+        if(workers == 0) {
+            unsigned int hardwareThreads = std::thread::hardware_concurrency();
+            workers = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+        }
+        for(size_t i = 0; i < workers; ++i)
+            m_workers.emplace_back([this] { workerMain(); });
+    }
+
+    // queued tasks still run before the workers exit
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        for(std::thread& worker : m_workers)
+            worker.join();
+    }
+
+    // threads that take part in parallelFor, the caller included
+    size_t getThreadCount() const { return m_workers.size() + 1; }
+    size_t getWorkerCount() const { return m_workers.size(); }
+
+    // runs task on a worker some time later, without workers it runs right away on the caller
+    void enqueue(std::function<void()> task) {
+        if(m_workers.empty()) {
+            task();
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.push_back(std::move(task));
+        }
+        m_wake.notify_one();
+    }
+
+    void parallelFor(size_t count, const std::function<void(size_t)>& job) {
+        if(count == 0)
+            return;
+        if(m_workers.empty() || count == 1) {
+            for(size_t i = 0; i < count; ++i)
+                job(i);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_job = &job;
+            m_count = count;
+            m_next = 0;
+            ++m_generation;
+        }
+        m_wake.notify_all();
+
+        runJobs();
+
+        // every index is taken, wait for the workers still running theirs; late ones find no job left
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this] { return m_busyWorkers == 0; });
+        m_job = nullptr;
+    }
+
+private:
+    void runJobs() {
+        size_t index;
+        while((index = m_next.fetch_add(1, std::memory_order_relaxed)) < m_count)
+            (*m_job)(index);
+    }
+
+    void workerMain() {
+        size_t generation = 0;
+        while(true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [&] { return m_stopping || (m_job && m_generation != generation) || !m_tasks.empty(); });
+                if(m_job && m_generation != generation) {
+                    generation = m_generation;
+                    ++m_busyWorkers;
+                } else if(!m_tasks.empty()) {
+                    task = std::move(m_tasks.front());
+                    m_tasks.pop_front();
+                } else
+                    return;
+            }
+
+            if(task) {
+                task();
+                continue;
+            }
+
+            runJobs();
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(--m_busyWorkers == 0)
+                m_done.notify_one();
+        }
+    }
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::deque<std::function<void()>> m_tasks;
+    const std::function<void(size_t)>* m_job = nullptr;
+    std::atomic<size_t> m_next{0};
+    size_t m_count = 0;
+    size_t m_busyWorkers = 0;
+    size_t m_generation = 0;
+    bool m_stopping = false;
+};
+
+#endif